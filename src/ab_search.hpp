@@ -0,0 +1,587 @@
+// clang-format off
+
+#pragma once
+
+#include "search.hpp"
+#include "tt.hpp"
+
+namespace ab { // Alpha-beta engine, an alternative to MCTS on the same board and move generation
+
+// Iterative deepening PVS with a transposition table, aspiration windows, null move pruning,
+// late move reductions, killer and history move ordering, and a quiescence search with SEE pruning
+// Lazy SMP: every thread runs the same iterative deepening, sharing only the transposition table,
+// and the main thread's result is played
+
+constexpr i32 INF = 32000, MATE_SCORE = 31000;
+constexpr i32 MIN_MATE_SCORE = MATE_SCORE - 1000;
+constexpr int MAX_DEPTH = 100, MAX_PLY = 128;
+
+constexpr i32 HISTORY_MAX = 16384;
+
+// Move ordering: TT move, good noisy moves, killers, quiets by history, bad noisy moves
+constexpr i32 TT_MOVE_SCORE = 2'000'000;
+constexpr i32 GOOD_NOISY_SCORE = 1'000'000;
+constexpr i32 KILLER_SCORE = 500'000;
+constexpr i32 BAD_NOISY_SCORE = -1'000'000;
+
+using Bound = TranspositionTable::Bound;
+
+struct ThreadData {
+    Board mBoard;
+    int mThreadIdx = 0;
+    std::atomic<u64> mNodes = 0;
+    int mRootDepth = 0;
+    int mSelDepth = 0;
+
+    std::vector<Move> mRootMoves = {};  // searchmoves, or empty
+    SearchParams mParams;
+    std::array<u64, 64 * 64> mRootMoveNodes = {}; // [from * 64 + to], for the time manager
+
+    MultiArray<Move, MAX_PLY + 1, 2> mKillers = {};
+    MultiArray<i32, 2, 64, 64> mHistory = {}; // [color][from][to]
+
+    MultiArray<Move, MAX_PLY + 1, MAX_PLY + 1> mPvTable = {};
+    std::array<int, MAX_PLY + 1> mPvLength = {};
+
+    // Result of the last completed iteration
+    std::vector<Move> mPv = {};
+    i32 mScore = 0;
+
+    inline u64 nodes() { return mNodes.load(std::memory_order_relaxed); }
+
+    // Only this thread writes its counter
+    inline void incNodes() { mNodes.store(nodes() + 1, std::memory_order_relaxed); }
+};
+
+// Threads of the current search, [0] is the main thread
+std::vector<std::unique_ptr<ThreadData>> threadsData;
+
+// Set by the main thread when it's done, to stop the helper threads
+std::atomic<bool> stopHelpers = false;
+
+u64 maxNodes = I64_MAX;
+
+inline u64 totalNodes()
+{
+    u64 nodes = 0;
+
+    for (std::unique_ptr<ThreadData> &td : threadsData)
+        nodes += td->nodes();
+
+    return nodes;
+}
+
+// The first iteration always completes, so that there is a move to play
+inline bool stopped(ThreadData &td)
+{
+    if (td.mRootDepth <= 1) return false;
+
+    if (stopSearch.load(std::memory_order_relaxed) || stopHelpers.load(std::memory_order_relaxed))
+        return true;
+
+    if (td.mThreadIdx == 0 && maxNodes != (u64)I64_MAX && td.nodes() % 1024 == 0 && totalNodes() >= maxNodes) {
+        stopHelpers = true;
+        return true;
+    }
+
+    return false;
+}
+
+// Mate scores are stored relative to the node, not to the root
+inline i16 scoreToTT(i32 score, int ply) {
+    return score >= MIN_MATE_SCORE ? score + ply : score <= -MIN_MATE_SCORE ? score - ply : score;
+}
+
+inline i32 scoreFromTT(i16 score, int ply) {
+    return score >= MIN_MATE_SCORE ? score - ply : score <= -MIN_MATE_SCORE ? score + ply : score;
+}
+
+inline std::string uciScore(i32 score)
+{
+    if (score >= MIN_MATE_SCORE)
+        return "mate " + std::to_string((MATE_SCORE - score + 1) / 2);
+
+    if (score <= -MIN_MATE_SCORE)
+        return "mate -" + std::to_string((MATE_SCORE + score) / 2);
+
+    return "cp " + std::to_string(score);
+}
+
+inline bool isNoisy(Board &board, Move move) {
+    return board.isCapture(move) || move.promotion() == PieceType::QUEEN;
+}
+
+inline void scoreMoves(ThreadData &td, MoveList &moves, std::array<i32, 256> &scores, Move ttMove, int ply)
+{
+    Board &board = td.mBoard;
+    int stm = (int)board.sideToMove();
+
+    for (u64 i = 0; i < moves.size(); i++)
+    {
+        Move move = moves[i];
+
+        if (move == ttMove)
+            scores[i] = TT_MOVE_SCORE;
+        else if (isNoisy(board, move))
+        {
+            // MVV-LVA
+            i32 score = 10 * SEE_PIECE_VALUES[(int)board.captured(move)] - SEE_PIECE_VALUES[(int)move.pieceType()];
+
+            if (move.promotion() == PieceType::QUEEN)
+                score += SEE_PIECE_VALUES[QUEEN];
+
+            scores[i] = score + (board.SEE(move, 0) ? GOOD_NOISY_SCORE : BAD_NOISY_SCORE);
+        }
+        else if (move == td.mKillers[ply][0])
+            scores[i] = KILLER_SCORE + 1;
+        else if (move == td.mKillers[ply][1])
+            scores[i] = KILLER_SCORE;
+        else
+            scores[i] = td.mHistory[stm][move.from()][move.to()];
+    }
+}
+
+// Selection sort step, moves are rarely all searched
+inline Move nextMove(MoveList &moves, std::array<i32, 256> &scores, u64 i)
+{
+    u64 best = i;
+
+    for (u64 j = i + 1; j < moves.size(); j++)
+        if (scores[j] > scores[best])
+            best = j;
+
+    std::swap(moves[i], moves[best]);
+    std::swap(scores[i], scores[best]);
+    return moves[i];
+}
+
+// History gravity keeps the values in [-HISTORY_MAX, HISTORY_MAX]
+inline void updateHistory(i32 &history, i32 bonus) {
+    history += bonus - history * abs(bonus) / HISTORY_MAX;
+}
+
+inline void updatePv(ThreadData &td, int ply, Move move)
+{
+    td.mPvTable[ply][0] = move;
+
+    for (int i = 0; i < td.mPvLength[ply + 1]; i++)
+        td.mPvTable[ply][i + 1] = td.mPvTable[ply + 1][i];
+
+    td.mPvLength[ply] = td.mPvLength[ply + 1] + 1;
+}
+
+template<bool PV_NODE>
+inline i32 qsearch(ThreadData &td, int ply, i32 alpha, i32 beta)
+{
+    Board &board = td.mBoard;
+
+    td.mPvLength[ply] = 0;
+    td.incNodes();
+    td.mSelDepth = std::max(td.mSelDepth, ply);
+
+    if (board.insufficientMaterial()) return 0;
+
+    if (stopped(td)) return 0;
+
+    bool inCheck = board.inCheck();
+
+    if (ply >= MAX_PLY) return inCheck ? 0 : board.evaluate();
+
+    TranspositionTable::Entry ttEntry;
+    bool ttHit = tt.probe(board.zobristHash(), ttEntry);
+    i32 ttScore = scoreFromTT(ttEntry.score, ply);
+
+    if (!PV_NODE && ttHit
+    && (ttEntry.bound == Bound::EXACT
+    || (ttEntry.bound == Bound::LOWER && ttScore >= beta)
+    || (ttEntry.bound == Bound::UPPER && ttScore <= alpha)))
+        return ttScore;
+
+    i32 bestScore = -INF;
+
+    if (!inCheck)
+    {
+        bestScore = board.evaluate();
+
+        if (bestScore >= beta) return bestScore;
+
+        alpha = std::max(alpha, bestScore);
+    }
+
+    MoveList moves;
+    board.legalMoves(moves, false);
+
+    if (moves.size() == 0)
+        return inCheck ? -MATE_SCORE + ply : 0;
+
+    std::array<i32, 256> scores;
+    scoreMoves(td, moves, scores, ttHit ? ttEntry.move : MOVE_NONE, ply);
+
+    Board::State state = board.state();
+    Move bestMove = MOVE_NONE;
+    i32 originalAlpha = alpha;
+
+    for (u64 i = 0; i < moves.size(); i++)
+    {
+        Move move = nextMove(moves, scores, i);
+
+        // Only noisy moves that don't lose material, unless in check
+        if (!inCheck && (!isNoisy(board, move) || !board.SEE(move, 0)))
+            continue;
+
+        board.makeMove(move);
+        i32 score = -qsearch<PV_NODE>(td, ply + 1, -beta, -alpha);
+        board.restore(state);
+
+        if (stopped(td)) return 0;
+
+        if (score <= bestScore) continue;
+
+        bestScore = score;
+
+        if (score > alpha) {
+            alpha = score;
+            bestMove = move;
+
+            if (PV_NODE) updatePv(td, ply, move);
+        }
+
+        if (score >= beta) break;
+    }
+
+    Bound bound = bestScore >= beta ? Bound::LOWER : alpha > originalAlpha ? Bound::EXACT : Bound::UPPER;
+    tt.store(board.zobristHash(), bestMove, scoreToTT(bestScore, ply), 0, bound);
+
+    return bestScore;
+}
+
+template<bool PV_NODE>
+inline i32 search(ThreadData &td, int depth, int ply, i32 alpha, i32 beta, bool allowNull = true)
+{
+    Board &board = td.mBoard;
+
+    if (depth <= 0) return qsearch<PV_NODE>(td, ply, alpha, beta);
+
+    td.mPvLength[ply] = 0;
+    td.incNodes();
+    td.mSelDepth = std::max(td.mSelDepth, ply);
+
+    if (ply > 0 && (board.insufficientMaterial() || board.fiftyMovesDraw() || board.isRepetition()))
+        return 0;
+
+    if (stopped(td)) return 0;
+
+    bool inCheck = board.inCheck();
+
+    if (ply >= MAX_PLY) return inCheck ? 0 : board.evaluate();
+
+    // Mate distance pruning
+    if (ply > 0) {
+        alpha = std::max(alpha, -MATE_SCORE + ply);
+        beta = std::min(beta, MATE_SCORE - ply - 1);
+        if (alpha >= beta) return alpha;
+    }
+
+    TranspositionTable::Entry ttEntry;
+    bool ttHit = tt.probe(board.zobristHash(), ttEntry);
+    i32 ttScore = scoreFromTT(ttEntry.score, ply);
+
+    if (!PV_NODE && ttHit && ttEntry.depth >= depth
+    && (ttEntry.bound == Bound::EXACT
+    || (ttEntry.bound == Bound::LOWER && ttScore >= beta)
+    || (ttEntry.bound == Bound::UPPER && ttScore <= alpha)))
+        return ttScore;
+
+    // Check extension
+    if (inCheck) depth++;
+
+    i32 eval = inCheck ? -INF : board.evaluate();
+
+    Board::State state = board.state();
+
+    // Null move pruning: if passing the turn still fails high, so will a real move (except in zugzwang)
+    if (!PV_NODE && !inCheck && allowNull && ply > 0 && depth >= 3 && eval >= beta && board.hasNonPawnMaterial())
+    {
+        int reduction = td.mParams.NMP_BASE_REDUCTION() + depth / td.mParams.NMP_DEPTH_DIVISOR();
+
+        board.makeNullMove();
+        i32 score = -search<false>(td, depth - 1 - reduction, ply + 1, -beta, -beta + 1, false);
+        board.restore(state);
+
+        if (stopped(td)) return 0;
+
+        // Unproven mates aren't returned
+        if (score >= beta) return score >= MIN_MATE_SCORE ? beta : score;
+    }
+
+    MoveList moves;
+    board.legalMoves(moves);
+
+    if (moves.size() == 0)
+        return inCheck ? -MATE_SCORE + ply : 0;
+
+    // searchmoves
+    if (ply == 0 && td.mRootMoves.size() > 0)
+    {
+        MoveList allMoves = moves;
+        moves.clear();
+
+        for (Move move : allMoves)
+            if (std::find(td.mRootMoves.begin(), td.mRootMoves.end(), move) != td.mRootMoves.end())
+                moves.push_back(move);
+    }
+
+    std::array<i32, 256> scores;
+    scoreMoves(td, moves, scores, ttHit ? ttEntry.move : MOVE_NONE, ply);
+
+    int stm = (int)board.sideToMove();
+    i32 bestScore = -INF;
+    Move bestMove = MOVE_NONE;
+    i32 originalAlpha = alpha;
+
+    // Quiets searched before the best move, their history is lowered on a cutoff
+    MoveList quietsTried;
+
+    for (u64 i = 0; i < moves.size(); i++)
+    {
+        Move move = nextMove(moves, scores, i);
+        bool isQuiet = !isNoisy(board, move);
+        u64 nodesBefore = td.nodes();
+
+        board.makeMove(move);
+
+        i32 score;
+
+        if (i == 0)
+            score = -search<PV_NODE>(td, depth - 1, ply + 1, -beta, -alpha);
+        else {
+            // Late move reductions for quiets that are ordered late, searched with a null window
+            int reduction = 0;
+
+            if (depth >= 3 && i >= 2 && isQuiet && !inCheck)
+            {
+                reduction = td.mParams.LMR_BASE() + ln(depth) * ln((double)i) / td.mParams.LMR_DIVISOR();
+                reduction -= PV_NODE;
+                reduction -= board.inCheck(); // the move gives check
+                reduction = std::clamp(reduction, 0, depth - 2);
+            }
+
+            score = -search<false>(td, depth - 1 - reduction, ply + 1, -alpha - 1, -alpha);
+
+            if (score > alpha && reduction > 0)
+                score = -search<false>(td, depth - 1, ply + 1, -alpha - 1, -alpha);
+
+            if (PV_NODE && score > alpha && score < beta)
+                score = -search<true>(td, depth - 1, ply + 1, -beta, -alpha);
+        }
+
+        board.restore(state);
+
+        if (stopped(td)) return 0;
+
+        if (ply == 0)
+            td.mRootMoveNodes[move.from() * 64 + move.to()] += td.nodes() - nodesBefore;
+
+        if (score > bestScore)
+        {
+            bestScore = score;
+
+            if (score > alpha) {
+                alpha = score;
+                bestMove = move;
+
+                if (PV_NODE) updatePv(td, ply, move);
+            }
+
+            if (score >= beta)
+            {
+                if (isQuiet)
+                {
+                    if (td.mKillers[ply][0] != move) {
+                        td.mKillers[ply][1] = td.mKillers[ply][0];
+                        td.mKillers[ply][0] = move;
+                    }
+
+                    i32 bonus = std::min(depth * depth, 1200);
+                    updateHistory(td.mHistory[stm][move.from()][move.to()], bonus);
+
+                    for (Move quiet : quietsTried)
+                        updateHistory(td.mHistory[stm][quiet.from()][quiet.to()], -bonus);
+                }
+
+                break;
+            }
+        }
+
+        if (isQuiet) quietsTried.push_back(move);
+    }
+
+    Bound bound = bestScore >= beta ? Bound::LOWER : alpha > originalAlpha ? Bound::EXACT : Bound::UPPER;
+    tt.store(board.zobristHash(), bestMove, scoreToTT(bestScore, ply), depth, bound);
+
+    return bestScore;
+}
+
+inline void printInfo(ThreadData &td, int depth, u64 milliseconds)
+{
+    u64 nodes = totalNodes();
+    std::stringstream info;
+
+    info << "info depth " << depth
+         << " seldepth "  << td.mSelDepth
+         << " score "     << uciScore(td.mScore)
+         << " nodes "     << nodes
+         << " nps "       << nodes * 1000 / std::max<u64>(milliseconds, 1)
+         << " time "      << milliseconds
+         << " hashfull "  << tt.hashfull()
+         << " pv";
+
+    for (Move move : td.mPv)
+        info << " " << move.toUci();
+
+    std::cout << info.str() << std::endl;
+}
+
+// Iterative deepening with aspiration windows, run by every thread
+inline void iterativeDeepening(ThreadData &td, TimeManager &timeManager, u64 maxDepth, bool boolPrintInfo,
+    std::chrono::time_point<std::chrono::steady_clock> startTime)
+{
+    for (int depth = 1; depth <= (int)std::min<u64>(maxDepth, MAX_DEPTH); depth++)
+    {
+        td.mRootDepth = depth;
+        td.mSelDepth = 0;
+
+        i32 delta = td.mParams.ASPIRATION_DELTA();
+        i32 alpha = -INF, beta = INF;
+
+        if (depth >= 5) {
+            alpha = std::max(td.mScore - delta, -INF);
+            beta = std::min(td.mScore + delta, INF);
+        }
+
+        i32 score;
+
+        while (true)
+        {
+            score = search<true>(td, depth, 0, alpha, beta);
+
+            if (stopped(td)) break;
+
+            if (score <= alpha) {
+                beta = (alpha + beta) / 2;
+                alpha = std::max(score - delta, -INF);
+            }
+            else if (score >= beta)
+                beta = std::min(score + delta, INF);
+            else
+                break;
+
+            delta *= 2;
+        }
+
+        if (stopped(td)) break;
+
+        td.mScore = score;
+        td.mPv.assign(td.mPvTable[0].begin(), td.mPvTable[0].begin() + td.mPvLength[0]);
+
+        if (td.mThreadIdx != 0) continue;
+
+        if (boolPrintInfo)
+            printInfo(td, depth, millisecondsElapsed(startTime));
+
+        if (totalNodes() >= maxNodes) break;
+
+        if (timeManager.isLimited() && td.mPv.size() > 0)
+        {
+            u64 rootNodes = 0;
+
+            for (u64 nodes : td.mRootMoveNodes)
+                rootNodes += nodes;
+
+            Move bestMove = td.mPv[0];
+            double bestShare = (double)td.mRootMoveNodes[bestMove.from() * 64 + bestMove.to()] / std::max<u64>(rootNodes, 1);
+
+            if (timeManager.softLimitReached(bestMove, bestShare))
+                break;
+        }
+    }
+}
+
+// Returns best move, ponder move (MOVE_NONE if unknown) and nodes, like the MCTS search
+inline std::tuple<Move, Move, u64> search(const Board &rootBoard, TimeManager &timeManager, u64 maxDepth, u64 maxNodes,
+    bool boolPrintInfo, u64 hashMb = DEFAULT_HASH_MB, u64 numThreads = 1, const std::vector<Move> &searchMoves = {},
+    const SearchParams &params = SearchParams())
+{
+    ProcessSearchGuard guard;
+
+    if (!guard.acquired()) {
+        if (boolPrintInfo) std::cout << "info string another alpha-beta or mate search is running" << std::endl;
+        return {MOVE_NONE, MOVE_NONE, 0};
+    }
+
+    // Allocating a large table takes a while, it isn't part of the search time
+    if (tt.sizeMb() != hashMb) tt.resize(hashMb);
+
+    std::chrono::time_point<std::chrono::steady_clock> startTime = std::chrono::steady_clock::now();
+
+    Board board = rootBoard;
+    std::vector<Move> moves;
+    board.legalMoves(moves);
+
+    // Only one legal move, no need to search it when playing on the clock
+    if (moves.size() == 1 && timeManager.isClockManaged() && !timeManager.isPondering())
+        return {moves[0], MOVE_NONE, 0};
+
+    // Illegal searchmoves are dropped; if none is left, every move is searched
+    std::vector<Move> rootMoves;
+
+    for (Move move : searchMoves)
+        if (std::find(moves.begin(), moves.end(), move) != moves.end())
+            rootMoves.push_back(move);
+
+    tt.newSearch();
+
+    ab::maxNodes = maxNodes;
+    stopHelpers = false;
+    threadsData.clear();
+
+    for (u64 i = 0; i < std::max<u64>(numThreads, 1); i++)
+    {
+        threadsData.push_back(std::make_unique<ThreadData>());
+        threadsData[i]->mBoard = rootBoard;
+        threadsData[i]->mThreadIdx = i;
+        threadsData[i]->mRootMoves = rootMoves;
+        threadsData[i]->mParams = params;
+    }
+
+    timeManager.startWatchdog(stopSearch);
+
+    std::vector<std::thread> helpers;
+
+    for (u64 i = 1; i < threadsData.size(); i++)
+        helpers.emplace_back([&, i] () {
+            iterativeDeepening(*threadsData[i], timeManager, maxDepth, false, startTime);
+        });
+
+    ThreadData &mainTd = *threadsData[0];
+    iterativeDeepening(mainTd, timeManager, maxDepth, boolPrintInfo, startTime);
+
+    stopHelpers = true;
+
+    for (std::thread &helper : helpers)
+        helper.join();
+
+    timeManager.stopWatchdog();
+
+    // No legal move at the root, or stopped before the first iteration ended
+    if (mainTd.mPv.empty()) {
+        Move fallback = rootMoves.size() > 0 ? rootMoves[0] : moves.size() > 0 ? moves[0] : MOVE_NONE;
+        return {fallback, MOVE_NONE, totalNodes()};
+    }
+
+    Move ponderMove = mainTd.mPv.size() > 1 ? mainTd.mPv[1] : MOVE_NONE;
+
+    return {mainTd.mPv[0], ponderMove, totalNodes()};
+}
+
+} // namespace ab
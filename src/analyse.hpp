@@ -0,0 +1,270 @@
+// clang-format off
+
+#pragma once
+
+#include <fstream>
+#include <string_view>
+#include "search.hpp"
+
+namespace analyse { // Offline analysis of EPD files: analyse <epd file> nodes|movetime N threads T out <file> [format json|binary]
+
+// The file is read into memory once, and the positions are views into it until a worker searches them
+// Workers take chunks of positions from a shared counter, so a worker that draws fast positions takes more of them
+// Each worker has its own search context (tree, eval cache, evaluators), so workers share nothing but the counter
+// and the output file, and throughput scales with the number of cores
+// Results are written as they complete, with the line of their position in the EPD file
+
+enum class OutputFormat { JSON, BINARY };
+
+constexpr u64 POSITIONS_PER_CHUNK = 16;
+constexpr u64 RESULTS_PER_WRITE = 64; // a worker's results are written together
+constexpr u64 MAX_BINARY_PV = 16;
+
+// Binary output: one 64-byte record per position, in the machine's byte order (little endian on x86 and ARM)
+// Moves are packed by packMove()
+struct BinaryRecord {
+    u64 nodes;
+    u32 line;     // 1-based line of the position in the EPD file
+    i32 cp;       // for the side to move, 0 if 'mate' isn't 0
+    i32 mate;     // moves to mate, negative if the side to move gets mated, 0 = none found
+    float wdl;    // expected result in [-1, 1] of the best move, for the side to move
+    u32 visits;   // of the best move
+    u16 bestMove;
+    u16 pvLength;
+    std::array<u16, MAX_BINARY_PV> pv;
+};
+
+static_assert(sizeof(BinaryRecord) == 64);
+
+struct Position {
+    std::string_view mEpd;
+    u32 mLine;
+};
+
+// EPD: 4 FEN fields followed by operations ("bm e4; id ..."); a FEN line (6 fields) is accepted too
+inline std::string fenFromEpd(std::string_view epd)
+{
+    std::string fen = "";
+    u64 numFields = 0, pos = 0;
+
+    while (pos < epd.size())
+    {
+        while (pos < epd.size() && isspace(epd[pos])) pos++;
+
+        u64 end = pos;
+        while (end < epd.size() && !isspace(epd[end])) end++;
+
+        if (end == pos) break;
+
+        std::string_view field = epd.substr(pos, end - pos);
+
+        // The halfmove clock and move number, if present, are numbers; an operation isn't
+        if (numFields >= 4 && (numFields >= 6 || field.find_first_not_of("0123456789") != std::string_view::npos))
+            break;
+
+        fen += (numFields > 0 ? " " : "") + std::string(field);
+        numFields++;
+        pos = end;
+    }
+
+    return fen;
+}
+
+// Splits the file into positions, skipping empty lines and comments (#)
+inline std::vector<Position> readPositions(std::string_view contents)
+{
+    std::vector<Position> positions;
+    u64 pos = 0;
+    u32 line = 0;
+
+    while (pos < contents.size())
+    {
+        u64 end = contents.find('\n', pos);
+        if (end == std::string_view::npos) end = contents.size();
+
+        std::string_view epd = contents.substr(pos, end - pos);
+        line++;
+        pos = end + 1;
+
+        u64 first = epd.find_first_not_of(" \t\r");
+
+        if (first != std::string_view::npos && epd[first] != '#')
+            positions.push_back({ epd, line });
+    }
+
+    return positions;
+}
+
+// Shared by the workers
+struct Output {
+    std::ofstream mFile;
+    OutputFormat mFormat = OutputFormat::JSON;
+    std::mutex mMutex;
+};
+
+inline void appendJson(std::string &out, u32 line, const std::string &fen, Move bestMove, i32 score, bool isMate,
+    double wdl, u32 visits, u64 nodes, std::vector<Move> &pv)
+{
+    out += "{\"line\":" + std::to_string(line)
+         + ",\"fen\":\"" + fen + "\""
+         + ",\"bestmove\":\"" + bestMove.toUci() + "\""
+         + (isMate ? ",\"mate\":" : ",\"cp\":") + std::to_string(score);
+
+    char wdlStr[16];
+    snprintf(wdlStr, sizeof(wdlStr), "%.4f", wdl);
+
+    out += ",\"wdl\":" + std::string(wdlStr)
+         + ",\"visits\":" + std::to_string(visits)
+         + ",\"nodes\":" + std::to_string(nodes)
+         + ",\"pv\":[";
+
+    for (u64 i = 0; i < pv.size(); i++)
+        out += (i > 0 ? ",\"" : "\"") + pv[i].toUci() + "\"";
+
+    out += "]}\n";
+}
+
+inline void appendBinary(std::string &out, u32 line, Move bestMove, i32 score, bool isMate,
+    double wdl, u32 visits, u64 nodes, std::vector<Move> &pv)
+{
+    BinaryRecord record = {};
+    record.nodes = nodes;
+    record.line = line;
+    (isMate ? record.mate : record.cp) = score;
+    record.wdl = wdl;
+    record.visits = visits;
+    record.bestMove = packMove(bestMove);
+    record.pvLength = std::min<u64>(pv.size(), MAX_BINARY_PV);
+
+    for (u64 i = 0; i < record.pvLength; i++)
+        record.pv[i] = packMove(pv[i]);
+
+    out.append((const char*)&record, sizeof(record));
+}
+
+inline void writeResults(Output &output, std::string &results)
+{
+    std::lock_guard<std::mutex> lock(output.mMutex);
+    output.mFile.write(results.data(), results.size());
+    results.clear();
+}
+
+// Returns the number of positions analysed (invalid ones and positions without legal moves are skipped)
+inline u64 worker(const std::vector<Position> &positions, std::atomic<u64> &nextChunk, Output &output,
+    const SearchParams &params, SearchLimits limits, u64 moveTimeMs)
+{
+    SearchContext context(params);
+    context.setOutput(nullptr);
+
+    std::string results = "";
+    std::vector<Move> pv;
+    u64 numAnalysed = 0, numPending = 0;
+
+    while (true)
+    {
+        u64 begin = nextChunk.fetch_add(1, std::memory_order_relaxed) * POSITIONS_PER_CHUNK;
+
+        if (begin >= positions.size()) break;
+
+        for (u64 i = begin; i < std::min<u64>(begin + POSITIONS_PER_CHUNK, positions.size()); i++)
+        {
+            std::string fen = fenFromEpd(positions[i].mEpd);
+
+            if (!isValidFen(fen)) continue;
+
+            Board board = Board(fen);
+            MoveList moves;
+            board.legalMoves(moves, false);
+
+            if (moves.size() == 0) continue;
+
+            TimeManager timeManager;
+            timeManager.init(I64_MAX, I64_MAX, 0, moveTimeMs, 0, false);
+
+            auto [bestMove, ponderMove, nodes] = context.search(board, timeManager, limits);
+
+            Node &root = context.root();
+            Edge *bestEdge = root.bestEdge();
+            bool isMate;
+            i32 score = root.score(params, isMate);
+            double wdl = isMate ? (score > 0 ? 1 : -1)
+                       : bestEdge->mVisits > 0 || bestEdge->mChild != nullptr ? bestEdge->Q()
+                       : 0;
+            Node::pv(*bestEdge, pv);
+
+            if (output.mFormat == OutputFormat::JSON)
+                appendJson(results, positions[i].mLine, fen, bestMove, score, isMate, wdl, bestEdge->mVisits, nodes, pv);
+            else
+                appendBinary(results, positions[i].mLine, bestMove, score, isMate, wdl, bestEdge->mVisits, nodes, pv);
+
+            numAnalysed++;
+
+            if (++numPending >= RESULTS_PER_WRITE) {
+                writeResults(output, results);
+                numPending = 0;
+            }
+        }
+    }
+
+    writeResults(output, results);
+    return numAnalysed;
+}
+
+// Either 'maxNodes' or 'moveTimeMs' (I64_MAX = not given) limits each search
+// The tree memory ('hashMb') is split between the workers
+inline void analyse(const std::string &epdPath, u64 maxNodes, u64 moveTimeMs, u64 numThreads,
+    const std::string &outPath, OutputFormat format, const SearchParams &params, u64 hashMb)
+{
+    std::ifstream epdFile(epdPath, std::ios::binary);
+
+    if (!epdFile) {
+        std::cout << "info string can't open " << epdPath << std::endl;
+        return;
+    }
+
+    std::string contents((std::istreambuf_iterator<char>(epdFile)), std::istreambuf_iterator<char>());
+    std::vector<Position> positions = readPositions(contents);
+
+    Output output;
+    output.mFormat = format;
+    output.mFile.open(outPath, std::ios::binary | std::ios::trunc);
+
+    if (!output.mFile) {
+        std::cout << "info string can't open " << outPath << std::endl;
+        return;
+    }
+
+    numThreads = std::clamp<u64>(numThreads, 1, std::max<u64>(positions.size(), 1));
+
+    SearchLimits limits;
+    limits.maxNodes = maxNodes;
+    limits.hashMb = std::max<u64>(hashMb / numThreads, 1);
+
+    // Every position gets its whole budget: smart pruning would end searches early, truncating visits and PVs
+    SearchParams analyseParams = params;
+    analyseParams.SMART_PRUNING.value = 0;
+
+    std::chrono::time_point<std::chrono::steady_clock> startTime = std::chrono::steady_clock::now();
+
+    std::atomic<u64> nextChunk = 0;
+    std::atomic<u64> numAnalysed = 0;
+    std::vector<std::thread> workers;
+
+    for (u64 i = 0; i < numThreads; i++)
+        workers.emplace_back([&] () {
+            numAnalysed += worker(positions, nextChunk, output, analyseParams, limits, moveTimeMs);
+        });
+
+    for (std::thread &worker : workers)
+        worker.join();
+
+    u64 ms = millisecondsElapsed(startTime);
+
+    std::cout << "info string analysed " << numAnalysed << " positions"
+              << " (skipped " << positions.size() - numAnalysed << ")"
+              << " in " << ms << " ms"
+              << ", " << numAnalysed * 1000 / std::max<u64>(ms, 1) << " positions/s"
+              << " with " << numThreads << " threads" << std::endl;
+}
+
+} // namespace analyse
@@ -3,6 +3,7 @@
 #pragma once
 
 #include "search.hpp"
+#include "ab_search.hpp"
 
 constexpr std::array BENCH_FENS {
     "r3k2r/2pb1ppp/2pp1q2/p7/1nP1B3/1P2P3/P2N1PPP/R2QK2R w KQkq a6 0 14",
@@ -57,9 +58,17 @@ constexpr std::array BENCH_FENS {
     "2r2b2/5p2/5k2/p1r1pP2/P2pB3/1P3P2/K1P3R1/7R w - - 23 93"
 };
 
-inline void bench(int depth = 4)
+constexpr int MCTS_BENCH_DEPTH = 4;
+constexpr int AB_BENCH_DEPTH = 9;
+constexpr u64 AB_BENCH_HASH_MB = 16;
+
+// Single threaded, with the engine selected by the Engine UCI option
+// depth 0 = the engine's default bench depth
+// The MCTS positions are searched in a fresh context, so bench doesn't touch the engine's tree and eval cache
+inline void bench(int depth = 0, const SearchParams &params = SearchParams())
 {
-    depth = std::max(depth, 1);
+    if (depth <= 0) 
+        depth = engine == Engine::ALPHA_BETA ? AB_BENCH_DEPTH : MCTS_BENCH_DEPTH;
 
     std::cout << "Running bench depth " << depth
               << " on " << BENCH_FENS.size() << " positions" 
@@ -68,11 +77,25 @@ inline void bench(int depth = 4)
     u64 totalNodes = 0;
     u64 totalMs = 0;
 
+    SearchContext context(params);
+    context.setOutput(nullptr);
+    stopSearch = false; // the UCI thread sets it before running a command
+
     for (std::string fen : BENCH_FENS) 
     {
         Board board = Board(fen);
         std::chrono::time_point<std::chrono::steady_clock> startTime = std::chrono::steady_clock::now();
-        auto [move, nodes] =  search(board, I64_MAX, depth, I64_MAX, false);
+        TimeManager timeManager;
+        u64 nodes;
+
+        if (engine == Engine::ALPHA_BETA) {
+            if (tt.sizeMb() != AB_BENCH_HASH_MB) tt.resize(AB_BENCH_HASH_MB);
+            tt.clear();
+            nodes = std::get<2>(ab::search(board, timeManager, depth, I64_MAX, false, AB_BENCH_HASH_MB, 1, {}, params));
+        }
+        else
+            nodes = std::get<2>(context.search(board, timeManager, SearchLimits { .maxDepth = (u64)depth }));
+
         totalMs += millisecondsElapsed(startTime);
         totalNodes += nodes;
     }
@@ -80,4 +103,34 @@ inline void bench(int depth = 4)
     std::cout << "nodes " << totalNodes 
               << " nps "  << totalNodes * 1000 / std::max<u64>(totalMs, 1) 
               << std::endl;
+
+    // The rest measures the MCTS leaf evaluators
+    if (engine == Engine::ALPHA_BETA) return;
+
+    std::cout << "evalcache hits " << context.evalCacheHits() << "/" << context.evalCacheProbes()
+              << " (" << context.evalCacheHits() * 100 / std::max<u64>(context.evalCacheProbes(), 1) << "%)"
+              << std::endl;
+
+    // Playout throughput with the current rollout policy (light if rollouts are off)
+    constexpr u64 PLAYOUTS_PER_POSITION = 1000;
+
+    TunableParam<i32> &rolloutPolicy = context.params().ROLLOUT_POLICY;
+    rolloutPolicy.value = std::max(rolloutPolicy(), 1);
+
+    u64 totalPlayouts = 0;
+    std::chrono::time_point<std::chrono::steady_clock> startTime = std::chrono::steady_clock::now();
+
+    for (std::string fen : BENCH_FENS) 
+    {
+        Board board = Board(fen);
+
+        for (u64 i = 0; i < PLAYOUTS_PER_POSITION; i++)
+            context.rolloutEvaluator().rollout(board);
+
+        totalPlayouts += PLAYOUTS_PER_POSITION;
+    }
+
+    std::cout << "playouts " << totalPlayouts
+              << " playouts/s " << totalPlayouts * 1000 / std::max<u64>(millisecondsElapsed(startTime), 1)
+              << std::endl;
 }
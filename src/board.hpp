@@ -7,6 +7,7 @@
 #include "utils.hpp"
 #include "move.hpp"
 #include "attacks.hpp"
+#include "nnue.hpp"
 
 u64 ZOBRIST_COLOR = 0;
 MultiArray<u64, 2, 6, 64> ZOBRIST_PIECES = {}; // [color][pieceType][square]
@@ -32,6 +33,8 @@ inline void initZobrist()
 
 constexpr int CASTLE_SHORT = 0, CASTLE_LONG = 1;
 
+constexpr std::array<i32, 7> SEE_PIECE_VALUES = {100, 300, 300, 500, 900, 0, 0}; // [pieceType]
+
 class Board {
     private:
 
@@ -53,8 +56,51 @@ class Board {
     Move mLastMove = MOVE_NONE;
     PieceType mCaptured = PieceType::NONE;
 
+    nnue::Accumulator mAccumulator;
+
     public:
 
+    // Everything makeMove() changes, to undo moves without copying the board (and its hashes history)
+    struct State {
+        Color colorToMove;
+        std::array<u64, 2> colorBitboards;
+        MultiArray<u64, 6> piecesBitboards;
+        u64 castlingRights;
+        Square enPassantSquare;
+        u8 pliesSincePawnOrCapture;
+        u16 currentMoveCounter;
+        u64 zobristHash;
+        u64 numZobristHashes;
+        Move lastMove;
+        PieceType captured;
+        nnue::Accumulator accumulator;
+    };
+
+    inline State state() {
+        return { mColorToMove, mColorBitboards, mPiecesBitboards, mCastlingRights, mEnPassantSquare,
+                 mPliesSincePawnOrCapture, mCurrentMoveCounter, mZobristHash, mZobristHashes.size(),
+                 mLastMove, mCaptured, mAccumulator };
+    }
+
+    // Undo the moves made since 'state' was taken
+    inline void restore(const State &state)
+    {
+        assert(mZobristHashes.size() >= state.numZobristHashes);
+
+        mColorToMove = state.colorToMove;
+        mColorBitboards = state.colorBitboards;
+        mPiecesBitboards = state.piecesBitboards;
+        mCastlingRights = state.castlingRights;
+        mEnPassantSquare = state.enPassantSquare;
+        mPliesSincePawnOrCapture = state.pliesSincePawnOrCapture;
+        mCurrentMoveCounter = state.currentMoveCounter;
+        mZobristHash = state.zobristHash;
+        mZobristHashes.resize(state.numZobristHashes);
+        mLastMove = state.lastMove;
+        mCaptured = state.captured;
+        mAccumulator = state.accumulator;
+    }
+
     inline Board() = default;
 
     // overload <<= operator to be a fast copy (this = other)
@@ -70,6 +116,7 @@ class Board {
         mZobristHash = other.mZobristHash;
         mLastMove = other.mLastMove;
         mCaptured = other.mCaptured;
+        mAccumulator = other.mAccumulator;
 
         assert(mZobristHashes.size() >= other.mZobristHashes.size());
         mZobristHashes.resize(other.mZobristHashes.size());
@@ -93,6 +140,7 @@ class Board {
 
         mColorBitboards = {};
         mPiecesBitboards = {};
+        mAccumulator.reset();
 
         std::string fenRows = fenSplit[0];
         int currentRank = 7, currentFile = 0; // iterate ranks from top to bottom, files from left to right
@@ -169,6 +217,15 @@ class Board {
 
     inline u64 zobristHash() { return mZobristHash; }
 
+    inline u8 pliesSincePawnOrCapture() { return mPliesSincePawnOrCapture; }
+
+    inline u16 currentMoveCounter() { return mCurrentMoveCounter; }
+
+    // Squares of the rooks that can still castle (CASTLING_MASKS)
+    inline u64 castlingRights() { return mCastlingRights; }
+
+    inline Square enPassantSquare() { return mEnPassantSquare; }
+
     inline PieceType pieceTypeAt(Square square) 
     { 
         if (!isOccupied(square)) return PieceType::NONE;
@@ -191,6 +248,8 @@ class Board {
         mPiecesBitboards[(int)pieceType] |=  1ULL << square;
 
         mZobristHash ^= ZOBRIST_PIECES[(int)color][(int)pieceType][square];
+
+        mAccumulator.update<true>(color, pieceType, square);
     }
 
     inline void removePiece(Color color, PieceType pieceType, Square square) 
@@ -202,6 +261,8 @@ class Board {
         mPiecesBitboards[(int)pieceType] ^= 1ULL << square;
 
         mZobristHash ^= ZOBRIST_PIECES[(int)color][(int)pieceType][square];
+
+        mAccumulator.update<false>(color, pieceType, square);
     }
 
     public:
@@ -297,11 +358,24 @@ class Board {
         std::cout << str << std::endl;
         std::cout << fen() << std::endl;
         std::cout << "Zobrist hash: " << mZobristHash << std::endl;
+        std::cout << "Eval: " << evaluate() << std::endl;
 
         if (mLastMove != MOVE_NONE)
             std::cout << "Last move: " << mLastMove.toUci() << std::endl;
     }
 
+    inline const nnue::Accumulator& accumulator() { return mAccumulator; }
+
+    // NNUE eval in centipawns, from the perspective of the side to move
+    inline i32 evaluate() {
+        return nnue::evaluate(mAccumulator, mColorToMove);
+    }
+
+    // Knights, bishops, rooks or queens of the side to move
+    inline bool hasNonPawnMaterial() {
+        return us() & ~(mPiecesBitboards[PAWN] | mPiecesBitboards[KING]);
+    }
+
     inline bool fiftyMovesDraw() {
         return mPliesSincePawnOrCapture >= 100;
     }
@@ -329,6 +403,21 @@ class Board {
         return false;
     }
 
+    // The game's draw by repetition; isRepetition() (twofold) is for the searches
+    inline bool isThreefoldRepetition() {
+        if (mZobristHashes.size() < 8 || mPliesSincePawnOrCapture < 8)
+            return false;
+
+        int idxAfterPawnOrCapture = std::max(0, (int)mZobristHashes.size() - (int)mPliesSincePawnOrCapture);
+        int count = 0;
+
+        for (int i = (int)mZobristHashes.size() - 2; i >= idxAfterPawnOrCapture; i -= 2)
+            if (mZobristHash == mZobristHashes[i] && ++count >= 2)
+                return true;
+
+        return false;
+    }
+
     inline bool isSquareAttacked(Square square, Color colorAttacking)
     {
         u64 colorBb = mColorBitboards[(int)colorAttacking];
@@ -450,6 +539,130 @@ class Board {
         return { pinnedNonDiagonal, pinnedDiagonal };
     }
 
+    inline bool isCapture(Move move) {
+        return move.flag() == Move::EN_PASSANT_FLAG 
+               || (move.flag() != Move::CASTLING_FLAG && isOccupied(move.to()));
+    }
+
+    inline PieceType captured(Move move) {
+        if (move.flag() == Move::EN_PASSANT_FLAG) return PieceType::PAWN;
+        if (move.flag() == Move::CASTLING_FLAG) return PieceType::NONE;
+        return pieceTypeAt(move.to());
+    }
+
+    inline bool givesCheck(Move move)
+    {
+        Square from = move.from();
+        Square to = move.to();
+        Square enemyKingSquare = lsb(them() & mPiecesBitboards[KING]);
+        PieceType pieceType = move.promotion() != PieceType::NONE ? move.promotion() : move.pieceType();
+
+        u64 occ = (occupancy() ^ (1ULL << from)) | (1ULL << to);
+        u64 ours = (us() ^ (1ULL << from)) | (1ULL << to);
+
+        if (move.flag() == Move::EN_PASSANT_FLAG)
+            occ ^= 1ULL << (mColorToMove == Color::WHITE ? to - 8 : to + 8);
+
+        // Direct check
+        u64 pieceAttacks = pieceType == PieceType::PAWN ? attacks::pawnAttacks(to, mColorToMove)
+                           : pieceType == PieceType::KNIGHT ? attacks::knightAttacks(to)
+                           : pieceType == PieceType::BISHOP ? attacks::bishopAttacks(to, occ)
+                           : pieceType == PieceType::ROOK ? attacks::rookAttacks(to, occ)
+                           : pieceType == PieceType::QUEEN ? attacks::queenAttacks(to, occ)
+                           : 0;
+
+        if (pieceAttacks & (1ULL << enemyKingSquare)) return true;
+
+        if (move.flag() == Move::CASTLING_FLAG) {
+            auto [rookFrom, rookTo] = CASTLING_ROOK_FROM_TO[to];
+            occ ^= (1ULL << rookFrom) | (1ULL << rookTo);
+            ours ^= (1ULL << rookFrom) | (1ULL << rookTo);
+
+            if (attacks::rookAttacks(rookTo, occ) & (1ULL << enemyKingSquare))
+                return true;
+        }
+
+        // Discovered check
+        u64 bishopsQueens = (mPiecesBitboards[BISHOP] | mPiecesBitboards[QUEEN]) & ours & ~(1ULL << to);
+        u64 rooksQueens = (mPiecesBitboards[ROOK] | mPiecesBitboards[QUEEN]) & ours & ~(1ULL << to);
+
+        return (bishopsQueens & attacks::bishopAttacks(enemyKingSquare, occ))
+               || (rooksQueens & attacks::rookAttacks(enemyKingSquare, occ));
+    }
+
+    // Static exchange evaluation: does this move win at least 'threshold' material?
+    inline bool SEE(Move move, i32 threshold = 0)
+    {
+        if (move.flag() == Move::CASTLING_FLAG) return threshold <= 0;
+
+        Square from = move.from();
+        Square to = move.to();
+        PieceType promotion = move.promotion();
+
+        i32 score = SEE_PIECE_VALUES[(int)captured(move)] - threshold;
+
+        if (promotion != PieceType::NONE) 
+            score += SEE_PIECE_VALUES[(int)promotion] - SEE_PIECE_VALUES[PAWN];
+
+        if (score < 0) return false;
+
+        PieceType next = promotion != PieceType::NONE ? promotion : move.pieceType();
+        score -= SEE_PIECE_VALUES[(int)next];
+
+        if (score >= 0) return true;
+
+        u64 occ = (occupancy() ^ (1ULL << from)) | (1ULL << to);
+
+        if (move.flag() == Move::EN_PASSANT_FLAG)
+            occ ^= 1ULL << (mColorToMove == Color::WHITE ? to - 8 : to + 8);
+
+        u64 bishopsQueens = mPiecesBitboards[BISHOP] | mPiecesBitboards[QUEEN];
+        u64 rooksQueens = mPiecesBitboards[ROOK] | mPiecesBitboards[QUEEN];
+
+        u64 allAttackers = mPiecesBitboards[PAWN] & attacks::pawnAttacks(to, Color::WHITE) & mColorBitboards[BLACK];
+        allAttackers |= mPiecesBitboards[PAWN] & attacks::pawnAttacks(to, Color::BLACK) & mColorBitboards[WHITE];
+        allAttackers |= mPiecesBitboards[KNIGHT] & attacks::knightAttacks(to);
+        allAttackers |= mPiecesBitboards[KING] & attacks::kingAttacks(to);
+        allAttackers |= bishopsQueens & attacks::bishopAttacks(to, occ);
+        allAttackers |= rooksQueens & attacks::rookAttacks(to, occ);
+        allAttackers &= occ;
+
+        Color color = oppColor(mColorToMove);
+
+        while (true)
+        {
+            u64 ourAttackers = allAttackers & mColorBitboards[(int)color];
+            if (ourAttackers == 0) break;
+
+            // Least valuable attacker
+            int attacker = PAWN;
+            while (attacker < KING && (ourAttackers & mPiecesBitboards[attacker]) == 0)
+                attacker++;
+
+            occ ^= 1ULL << lsb(ourAttackers & mPiecesBitboards[attacker]);
+
+            if (attacker == PAWN || attacker == BISHOP || attacker == QUEEN)
+                allAttackers |= bishopsQueens & attacks::bishopAttacks(to, occ);
+
+            if (attacker == ROOK || attacker == QUEEN)
+                allAttackers |= rooksQueens & attacks::rookAttacks(to, occ);
+
+            allAttackers &= occ;
+            color = oppColor(color);
+            score = -score - 1 - SEE_PIECE_VALUES[attacker];
+
+            if (score >= 0) {
+                // Our king can't recapture into a defended square
+                if (attacker == KING && (allAttackers & mColorBitboards[(int)color]))
+                    color = oppColor(color);
+
+                break;
+            }
+        }
+
+        return color != mColorToMove;
+    }
+
     inline Move uciToMove(std::string uciMove)
     {
         Square from = strToSquare(uciMove.substr(0,2));
@@ -490,6 +703,18 @@ class Board {
         makeMove(uciToMove(uciMove));
     }
 
+    // MOVE_NONE if 'uciMove' isn't a legal move here (uciToMove() trusts its input)
+    inline Move legalMoveFromUci(const std::string &uciMove)
+    {
+        MoveList moves;
+        legalMoves(moves);
+
+        for (Move move : moves)
+            if (move.toUci() == uciMove) return move;
+
+        return MOVE_NONE;
+    }
+
     inline void makeMove(Move move)
     {
         mZobristHashes.push_back(mZobristHash);
@@ -573,10 +798,32 @@ class Board {
         mLastMove = move;
     }
 
-    inline void legalMoves(std::vector<Move> &moves, bool underpromotions = true)
+    // Pass the turn (null move pruning), never when in check
+    // The plies counter restarts so that repetitions aren't detected across the null move
+    inline void makeNullMove()
     {
-        moves = {};
-        moves.reserve(32);
+        assert(!inCheck());
+
+        mZobristHashes.push_back(mZobristHash);
+
+        if (mEnPassantSquare != SQUARE_NONE)
+        {
+            mZobristHash ^= ZOBRIST_FILES[(int)squareFile(mEnPassantSquare)];
+            mEnPassantSquare = SQUARE_NONE;
+        }
+
+        mColorToMove = oppColor(mColorToMove);
+        mZobristHash ^= ZOBRIST_COLOR;
+        mPliesSincePawnOrCapture = 0;
+        mLastMove = MOVE_NONE;
+        mCaptured = PieceType::NONE;
+    }
+
+    // 'moves' is a MoveList or a std::vector<Move>
+    template <typename MoveContainer>
+    inline void legalMoves(MoveContainer &moves, bool underpromotions = true)
+    {
+        moves.clear();
         
         Color enemyColor = oppColor(mColorToMove);
         u64 occ = occupancy();
@@ -597,10 +844,7 @@ class Board {
         assert(numCheckers <= 2);
 
         // If in double check, only king moves are allowed
-        if (numCheckers > 1) {
-            moves.shrink_to_fit();
-            return;
-        }
+        if (numCheckers > 1) return;
 
         u64 movableBb = ONES;
         
@@ -656,6 +900,7 @@ class Board {
                 auto colorBitboards = mColorBitboards;
                 auto pawnBb = mPiecesBitboards[PAWN];
                 auto zobristHash = mZobristHash;
+                auto accumulator = mAccumulator;
 
                 // Make the en passant move
 
@@ -675,6 +920,7 @@ class Board {
                 mColorBitboards = colorBitboards;
                 mPiecesBitboards[PAWN] = pawnBb;
                 mZobristHash = zobristHash;
+                mAccumulator = accumulator;
             }
         }
 
@@ -788,13 +1034,12 @@ class Board {
                 moves.push_back(Move(sq, targetSquare, Move::QUEEN_FLAG));
             }
         }
-
-        moves.shrink_to_fit();
     }
 
     private:
 
-    inline void addPromotions(std::vector<Move> &moves, Square sq, Square targetSquare, bool underpromotions)
+    template <typename MoveContainer>
+    inline void addPromotions(MoveContainer &moves, Square sq, Square targetSquare, bool underpromotions)
     {
         moves.push_back(Move(sq, targetSquare, Move::QUEEN_PROMOTION_FLAG));
         if (underpromotions) {
@@ -804,4 +1049,61 @@ class Board {
         }
     }
 
-}; // class Board
\ No newline at end of file
+}; // class Board
+
+// The board doesn't validate FENs, so a FEN from an untrusted source must be checked before reaching it
+inline bool isValidFen(std::string fen)
+{
+    std::vector<std::string> fields = splitString(fen, ' ');
+
+    if (fields.size() < 4 || fields.size() > 6) return false;
+
+    std::vector<std::string> ranks = splitString(fields[0], '/');
+
+    if (ranks.size() != 8) return false;
+
+    for (u64 i = 0; i < ranks.size(); i++)
+    {
+        int files = 0;
+
+        for (char c : ranks[i])
+        {
+            if (c >= '1' && c <= '8')
+                files += c - '0';
+            else if (std::string("pnbrqkPNBRQK").find(c) != std::string::npos) {
+                // No pawns on the first and last ranks
+                if ((c == 'p' || c == 'P') && (i == 0 || i == 7)) return false;
+
+                files++;
+            }
+            else
+                return false;
+        }
+
+        if (files != 8) return false;
+    }
+
+    if (std::count(fields[0].begin(), fields[0].end(), 'K') != 1
+    ||  std::count(fields[0].begin(), fields[0].end(), 'k') != 1)
+        return false;
+
+    if (fields[1] != "w" && fields[1] != "b") return false;
+
+    if (fields[2] != "-" && (fields[2].size() > 4 || fields[2].find_first_not_of("KQkq") != std::string::npos))
+        return false;
+
+    if (fields[3] != "-" && (fields[3].size() != 2 || fields[3][0] < 'a' || fields[3][0] > 'h'
+    || (fields[3][1] != '3' && fields[3][1] != '6')))
+        return false;
+
+    for (u64 i = 4; i < fields.size(); i++)
+        if (fields[i].size() == 0 || fields[i].size() > 6 || fields[i].find_first_not_of("0123456789") != std::string::npos)
+            return false;
+
+    // The side that just moved can't be in check
+    Board board = Board(fen);
+    Color them = oppColor(board.sideToMove());
+    Square theirKing = lsb(board.getBitboard(them) & board.getBitboard(PieceType::KING));
+
+    return !board.isSquareAttacked(theirKing, board.sideToMove());
+}
@@ -0,0 +1,374 @@
+// clang-format off
+
+#pragma once
+
+#include <fstream>
+#include "search.hpp"
+
+namespace datagen { // Self-play training data: datagen nodes N games G [threads T] out <file> [openingplies P] [seed S]
+
+// Each thread plays whole games with its own search context, one fixed node search per move,
+// starting from a few random plies so that the games differ
+// A thread serializes its games into its own buffer, which is appended to the file when large,
+// so the file gets few big sequential writes and the games of different threads never interleave
+
+// File format (version 1), little endian, no padding between fields:
+//
+// File header, 8 bytes: "NCDG" | u16 version | u16 reserved (0)
+// Then games until the end of the file, each:
+//     Game header, 4 bytes: u16 number of positions | i8 result (1 white won, 0 draw, -1 black won) | u8 reserved (0)
+//     Then each position of the game in order, each:
+//         PackedBoard, 32 bytes
+//         i16 score of the side to move: centipawns in [-MAX_CP, MAX_CP],
+//             or MATE_SCORE - moves if it mates, -MATE_SCORE + moves if it gets mated
+//         u8 number of root moves with visits (n) | u8 reserved (0)
+//         n times: u16 move (packMove()) | u16 visits
+//             the move played first, then the others by most visits
+//             visits above 65535 are scaled down, keeping the distribution
+//
+// The random opening plies aren't recorded, and positions where the game is already over aren't either
+
+constexpr std::array<char, 4> MAGIC = {'N', 'C', 'D', 'G'};
+constexpr u16 FORMAT_VERSION = 1;
+
+constexpr i16 MATE_SCORE = 32000;
+constexpr i16 MAX_CP = 30000;
+constexpr u64 MAX_VISITS = 65535;
+
+constexpr u64 DEFAULT_OPENING_PLIES = 8;
+constexpr u64 MAX_GAME_PLIES = 400;     // then the game is a draw
+constexpr u64 BUFFER_BYTES = 1ULL << 22; // of each thread, before writing to the file
+constexpr u64 PROGRESS_GAMES = 100;     // progress is printed every PROGRESS_GAMES games
+
+// Occupancy, then the piece of each occupied square in 4 bits (Piece: WHITE_PAWN = 0 ... BLACK_KING = 11),
+// from a1 to h8, first piece in the low bits of pieces[0]
+struct PackedBoard {
+    u64 occupancy;
+    std::array<u8, 16> pieces;
+    u8 sideToMove;      // 0 white, 1 black
+    u8 enPassantSquare; // 64 = none
+    u8 castlingRights;  // 1 = K, 2 = Q, 4 = k, 8 = q
+    u8 pliesSincePawnOrCapture;
+    u16 currentMoveCounter;
+    u16 reserved;
+
+    inline PackedBoard(Board &board)
+    {
+        *this = {};
+        occupancy = board.occupancy();
+
+        u64 occ = occupancy;
+        u64 i = 0;
+
+        while (occ > 0)
+        {
+            Square square = poplsb(occ);
+            Color color = board.getBitboard(Color::WHITE) & (1ULL << square) ? Color::WHITE : Color::BLACK;
+            u8 piece = (u8)makePiece(board.pieceTypeAt(square), color);
+
+            pieces[i / 2] |= piece << (i % 2 * 4);
+            i++;
+        }
+
+        sideToMove = board.sideToMove() == Color::WHITE ? 0 : 1;
+        enPassantSquare = board.enPassantSquare() == SQUARE_NONE ? 64 : board.enPassantSquare();
+        pliesSincePawnOrCapture = board.pliesSincePawnOrCapture();
+        currentMoveCounter = board.currentMoveCounter();
+
+        u64 castling = board.castlingRights();
+        castlingRights = (castling & CASTLING_MASKS[WHITE][CASTLE_SHORT] ? 1 : 0)
+                       | (castling & CASTLING_MASKS[WHITE][CASTLE_LONG]  ? 2 : 0)
+                       | (castling & CASTLING_MASKS[BLACK][CASTLE_SHORT] ? 4 : 0)
+                       | (castling & CASTLING_MASKS[BLACK][CASTLE_LONG]  ? 8 : 0);
+    }
+
+    inline PackedBoard() = default;
+
+    // For readers and tests
+    inline std::string fen()
+    {
+        std::array<char, 64> board;
+        board.fill(' ');
+
+        u64 occ = occupancy;
+        u64 i = 0;
+
+        while (occ > 0)
+        {
+            Square square = poplsb(occ);
+            board[square] = PIECE_TO_CHAR[(Piece)((pieces[i / 2] >> (i % 2 * 4)) & 0xF)];
+            i++;
+        }
+
+        std::string fen = "";
+
+        for (int rank = 7; rank >= 0; rank--)
+        {
+            int empty = 0;
+
+            for (int file = 0; file < 8; file++)
+            {
+                char c = board[rank * 8 + file];
+
+                if (c == ' ') {
+                    empty++;
+                    continue;
+                }
+
+                if (empty > 0) fen += std::to_string(empty);
+
+                fen += c;
+                empty = 0;
+            }
+
+            if (empty > 0) fen += std::to_string(empty);
+
+            if (rank > 0) fen += "/";
+        }
+
+        fen += sideToMove == 0 ? " w " : " b ";
+
+        std::string castling = std::string(castlingRights & 1 ? "K" : "") + (castlingRights & 2 ? "Q" : "")
+                             + (castlingRights & 4 ? "k" : "") + (castlingRights & 8 ? "q" : "");
+
+        fen += castling == "" ? "-" : castling;
+        fen += " " + (enPassantSquare == 64 ? std::string("-") : SQUARE_TO_STR[enPassantSquare]);
+        fen += " " + std::to_string(pliesSincePawnOrCapture) + " " + std::to_string(currentMoveCounter);
+
+        return fen;
+    }
+
+}; // struct PackedBoard
+
+static_assert(sizeof(PackedBoard) == 32);
+
+template <typename T>
+inline void append(std::string &out, T value) {
+    out.append((const char*)&value, sizeof(T));
+}
+
+// Shared by the threads
+struct Output {
+    std::ofstream mFile;
+    std::mutex mMutex;
+    std::atomic<u64> mNextGame = 0;
+    std::atomic<u64> mGamesDone = 0;
+    std::atomic<u64> mPositions = 0;
+    std::chrono::time_point<std::chrono::steady_clock> mStartTime;
+};
+
+inline void writeBuffer(Output &output, std::string &buffer)
+{
+    std::lock_guard<std::mutex> lock(output.mMutex);
+    output.mFile.write(buffer.data(), buffer.size());
+    buffer.clear();
+}
+
+// The search's score as stored in the file
+inline i16 packScore(Node &root, const SearchParams &params)
+{
+    bool isMate;
+    i32 score = root.score(params, isMate);
+
+    if (isMate)
+        return score > 0 ? MATE_SCORE - score : -MATE_SCORE - score;
+
+    return std::clamp<i32>(score, -MAX_CP, MAX_CP);
+}
+
+// Appends a position, the search's score and its root visits to 'game'
+inline void appendPosition(std::string &game, Board &board, Node &root, Move movePlayed, const SearchParams &params)
+{
+    append(game, PackedBoard(board));
+    append(game, packScore(root, params));
+
+    // The move played first (the Gumbel root doesn't always play the most visited), then the others by visits
+    Edge *bestEdge = root.bestEdge();
+
+    for (Edge &edge : root.mEdges)
+        if (edge.mMove == movePlayed) bestEdge = &edge;
+
+    std::vector<Edge*> edges = { bestEdge };
+    u32 maxVisits = std::max<u32>(bestEdge->mVisits, 1);
+
+    for (Edge &edge : root.mEdges)
+        if (&edge != bestEdge && edge.mVisits > 0) {
+            edges.push_back(&edge);
+            maxVisits = std::max(maxVisits, edge.mVisits);
+        }
+
+    std::stable_sort(edges.begin() + 1, edges.end(), [] (Edge *a, Edge *b) {
+        return a->mVisits > b->mVisits;
+    });
+
+    append<u8>(game, edges.size());
+    append<u8>(game, 0);
+
+    for (Edge *edge : edges)
+    {
+        // The move played has at least 1 visit, e.g. a mate in one found without searching
+        u64 visits = std::max<u64>(edge->mVisits, edge == bestEdge ? 1 : 0);
+
+        if (maxVisits > MAX_VISITS)
+            visits = std::max<u64>(visits * MAX_VISITS / maxVisits, 1);
+
+        append<u16>(game, packMove(edge->mMove));
+        append<u16>(game, visits);
+    }
+}
+
+// Plays a game and appends it to 'buffer', returns the number of positions recorded
+inline u64 playGame(SearchContext &context, Rng &rng, u64 maxNodes, u64 hashMb, u64 openingPlies, std::string &buffer)
+{
+    Board board = Board(START_FEN);
+    MoveList moves;
+
+    // Random opening, restarted if it ends the game
+    for (u64 ply = 0; ply < openingPlies; )
+    {
+        board.legalMoves(moves, false);
+
+        if (moves.size() == 0) {
+            board = Board(START_FEN);
+            ply = 0;
+            continue;
+        }
+
+        board.makeMove(moves[rng.next() % moves.size()]);
+        ply++;
+    }
+
+    std::string game = "";
+    u64 numPositions = 0;
+    i8 result = 0; // of the side to move when the game ends, then of white
+
+    SearchLimits limits;
+    limits.maxNodes = maxNodes;
+    limits.hashMb = hashMb;
+
+    for (u64 ply = 0; ply < MAX_GAME_PLIES; ply++)
+    {
+        board.legalMoves(moves, false);
+
+        if (moves.size() == 0) {
+            result = board.inCheck() ? -1 : 0;
+            break;
+        }
+
+        // A twofold repetition isn't a draw yet, the game goes on
+        if (board.fiftyMovesDraw() || board.insufficientMaterial() || board.isThreefoldRepetition())
+            break;
+
+        TimeManager timeManager;
+        timeManager.init(I64_MAX, I64_MAX, 0, I64_MAX, 0, false);
+
+        auto [bestMove, ponderMove, nodes] = context.search(board, timeManager, limits);
+
+        Node &root = context.root();
+        appendPosition(game, board, root, bestMove, context.params());
+        numPositions++;
+
+        // Adjudicate proven results instead of playing them out
+        if (root.mGameState != GameState::ONGOING)
+        {
+            result = root.mGameState == GameState::WON ? 1 : root.mGameState == GameState::LOST ? -1 : 0;
+            break;
+        }
+
+        board.makeMove(bestMove);
+    }
+
+    context.releaseTree();
+
+    if (board.sideToMove() == Color::BLACK) result = -result;
+
+    append<u16>(buffer, numPositions);
+    append<i8>(buffer, result);
+    append<u8>(buffer, 0);
+    buffer += game;
+
+    return numPositions;
+}
+
+inline void worker(Output &output, const SearchParams &params, u64 numGames, u64 maxNodes, u64 hashMb,
+    u64 openingPlies, u64 seed)
+{
+    SearchContext context(params);
+    context.setOutput(nullptr);
+
+    Rng rng;
+    rng.mX ^= seed;
+    rng.next();
+
+    std::string buffer = "";
+    buffer.reserve(BUFFER_BYTES * 2);
+
+    while (output.mNextGame++ < numGames)
+    {
+        output.mPositions += playGame(context, rng, maxNodes, hashMb, openingPlies, buffer);
+
+        if (buffer.size() >= BUFFER_BYTES)
+            writeBuffer(output, buffer);
+
+        u64 gamesDone = ++output.mGamesDone;
+
+        if (gamesDone % PROGRESS_GAMES == 0)
+        {
+            u64 ms = std::max<u64>(millisecondsElapsed(output.mStartTime), 1);
+            u64 positions = output.mPositions;
+
+            std::lock_guard<std::mutex> lock(output.mMutex);
+
+            std::cout << "info string games " << gamesDone
+                      << " positions " << positions
+                      << " positions/s " << positions * 1000 / ms
+                      << std::endl;
+        }
+    }
+
+    writeBuffer(output, buffer);
+}
+
+// The tree memory ('hashMb') is split between the threads
+inline void datagen(u64 maxNodes, u64 numGames, u64 numThreads, const std::string &outPath,
+    u64 openingPlies, u64 seed, const SearchParams &params, u64 hashMb)
+{
+    Output output;
+    output.mFile.open(outPath, std::ios::binary | std::ios::trunc);
+
+    if (!output.mFile) {
+        std::cout << "info string can't open " << outPath << std::endl;
+        return;
+    }
+
+    output.mFile.write(MAGIC.data(), MAGIC.size());
+    output.mFile.write((const char*)&FORMAT_VERSION, sizeof(FORMAT_VERSION));
+    output.mFile.write("\0\0", 2);
+
+    numThreads = std::clamp<u64>(numThreads, 1, std::max<u64>(numGames, 1));
+
+    // Smart pruning would end the searches before their node budget, truncating the visit distributions
+    SearchParams datagenParams = params;
+    datagenParams.SMART_PRUNING.value = 0;
+
+    output.mStartTime = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> threads;
+
+    for (u64 i = 0; i < numThreads; i++)
+        threads.emplace_back(worker, std::ref(output), std::cref(datagenParams), numGames, maxNodes,
+                             std::max<u64>(hashMb / numThreads, 1), openingPlies, seed + (i + 1) * 0x9E3779B97F4A7C15ULL);
+
+    for (std::thread &thread : threads)
+        thread.join();
+
+    u64 ms = std::max<u64>(millisecondsElapsed(output.mStartTime), 1);
+
+    std::cout << "info string datagen done: games " << output.mGamesDone
+              << " positions " << output.mPositions
+              << " in " << ms << " ms"
+              << ", " << output.mPositions * 1000 / ms << " positions/s"
+              << " with " << numThreads << " threads" << std::endl;
+}
+
+} // namespace datagen
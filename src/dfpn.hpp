@@ -0,0 +1,423 @@
+// clang-format off
+
+#pragma once
+
+#include "search.hpp"
+
+namespace dfpn { // Depth-first proof-number search, for go mate N
+
+// The side to move at the root attacks and only plays checks (OR nodes), the defender plays every legal move (AND nodes)
+// Proof and disproof numbers live in a table of bounded size, entries are keyed by the position and the plies left,
+// so a position's result doesn't leak into a search with a different depth limit, and the search graph has no cycles
+// Mate in 1, 2, ..., N is searched, so the first mate found is the shortest with checks only
+
+constexpr u32 INF = 100'000'000;
+
+constexpr u64 DEFAULT_MATE_HASH_MB = 64;
+
+class MateTable {
+    public:
+
+    struct Entry {
+        u64 key = 0; // 0 = empty
+        u32 pn = 1;
+        u32 dn = 1;
+        u32 work = 0; // nodes searched under this entry, big subtrees are kept
+    };
+
+    private:
+
+    constexpr static u64 ENTRIES_PER_BUCKET = 4;
+
+    struct Bucket {
+        std::array<Entry, ENTRIES_PER_BUCKET> mEntries;
+    };
+
+    std::vector<Bucket> mBuckets = {};
+    u64 mSizeMb = 0;
+
+    inline Bucket& bucket(u64 key) {
+        return mBuckets[(u128)key * (u128)mBuckets.size() >> 64];
+    }
+
+    public:
+
+    inline u64 sizeMb() { return mSizeMb; }
+
+    // Allocated on the first search, not at startup
+    inline void resize(u64 sizeMb)
+    {
+        mSizeMb = sizeMb;
+        mBuckets = std::vector<Bucket>(std::max<u64>(sizeMb * 1024 * 1024 / sizeof(Bucket), 1));
+        mBuckets.shrink_to_fit();
+    }
+
+    inline void clear() {
+        std::fill(mBuckets.begin(), mBuckets.end(), Bucket());
+    }
+
+    // Unknown positions have pn = dn = 1
+    inline Entry probe(u64 key)
+    {
+        for (Entry &entry : bucket(key).mEntries)
+            if (entry.key == key) return entry;
+
+        return Entry();
+    }
+
+    // Replaces the entry with the same key, else the one with the least work
+    inline void store(u64 key, u32 pn, u32 dn, u32 work)
+    {
+        Bucket &bucket = this->bucket(key);
+        Entry *replace = &bucket.mEntries[0];
+
+        for (Entry &entry : bucket.mEntries)
+        {
+            if (entry.key == key) {
+                replace = &entry;
+                break;
+            }
+
+            if (entry.work < replace->work) replace = &entry;
+        }
+
+        *replace = { key, pn, dn, std::max<u32>(work, replace->key == key ? replace->work : 0) };
+    }
+
+    // Permille of the sampled entries in use
+    inline int hashfull()
+    {
+        u64 numSampled = std::min<u64>(1000 / ENTRIES_PER_BUCKET, mBuckets.size());
+        u64 numFull = 0;
+
+        for (u64 i = 0; i < numSampled; i++)
+            for (Entry &entry : mBuckets[i].mEntries)
+                numFull += entry.key != 0;
+
+        return numFull * 1000 / std::max<u64>(numSampled * ENTRIES_PER_BUCKET, 1);
+    }
+
+}; // class MateTable
+
+MateTable mateTable;
+u64 mateTableMb = DEFAULT_MATE_HASH_MB;
+
+// A position and the plies left to mate
+inline u64 tableKey(u64 zobristHash, int pliesLeft) {
+    return (zobristHash ^ ((u64)(pliesLeft + 1) * 0x9E37'79B9'7F4A'7C15ULL)) | 1;
+}
+
+class MateSearch {
+    private:
+
+    Board mBoard;
+    Color mAttacker;
+    u64 mRootHash;
+    u64 mMaxNodes;
+    bool mPrintInfo;
+    std::chrono::time_point<std::chrono::steady_clock> mStartTime;
+    u64 mLastInfoMs = 0;
+
+    u64 mNodes = 0;
+    int mRootPlies = 0;
+    bool mStopped = false;
+
+    // Attacker: checks only; defender: every legal move
+    inline void genMoves(MoveList &moves)
+    {
+        if (mBoard.sideToMove() != mAttacker) {
+            mBoard.legalMoves(moves);
+            return;
+        }
+
+        MoveList allMoves;
+        mBoard.legalMoves(allMoves);
+        moves.clear();
+
+        for (Move move : allMoves)
+            if (mBoard.givesCheck(move))
+                moves.push_back(move);
+    }
+
+    inline void checkLimits()
+    {
+        if (stopSearch.load(std::memory_order_relaxed) || mNodes >= mMaxNodes) {
+            mStopped = true;
+            return;
+        }
+
+        u64 elapsed = millisecondsElapsed(mStartTime);
+
+        if (mPrintInfo && elapsed >= mLastInfoMs + 1000)
+        {
+            MateTable::Entry root = mateTable.probe(tableKey(mRootHash, mRootPlies));
+
+            std::cout << "info depth " << mRootPlies
+                      << " nodes "     << mNodes
+                      << " nps "       << mNodes * 1000 / std::max<u64>(elapsed, 1)
+                      << " time "      << elapsed
+                      << " hashfull "  << mateTable.hashfull()
+                      << " string pn " << root.pn << " dn " << root.dn
+                      << std::endl;
+
+            mLastInfoMs = elapsed;
+        }
+    }
+
+    // Multiple iterative deepening: searches the node until its pn or dn reaches its threshold
+    inline void mid(int pliesLeft, u32 thPn, u32 thDn)
+    {
+        if (++mNodes % 1024 == 0) checkLimits();
+
+        u64 key = tableKey(mBoard.zobristHash(), pliesLeft);
+        bool orNode = mBoard.sideToMove() == mAttacker;
+        u64 nodesBefore = mNodes;
+
+        MoveList moves;
+        genMoves(moves);
+
+        // Terminal: mated, stalemated, out of checks or out of plies
+        if (moves.size() == 0 || (!orNode && pliesLeft == 0))
+        {
+            bool proven = !orNode && moves.size() == 0 && mBoard.inCheck();
+            mateTable.store(key, proven ? 0 : INF, proven ? INF : 0, 1);
+            return;
+        }
+
+        std::array<u64, 256> childKeys;
+        Board::State state = mBoard.state();
+
+        for (u64 i = 0; i < moves.size(); i++) {
+            mBoard.makeMove(moves[i]);
+            childKeys[i] = tableKey(mBoard.zobristHash(), pliesLeft - 1);
+            mBoard.restore(state);
+        }
+
+        // OR node: pn = min(children pn), dn = sum(children dn)
+        // AND node: pn = sum(children pn), dn = min(children dn)
+        // Written as phi (the min side) and delta (the sum side) of the side to move
+        u32 phi, delta;
+
+        while (true)
+        {
+            u32 minPhi = INF, secondPhi = INF, sumDelta = 0;
+            u64 bestIdx = 0;
+
+            for (u64 i = 0; i < moves.size(); i++)
+            {
+                MateTable::Entry child = mateTable.probe(childKeys[i]);
+                u32 childPhi = orNode ? child.pn : child.dn;
+                u32 childDelta = orNode ? child.dn : child.pn;
+
+                if (childPhi < minPhi) {
+                    secondPhi = minPhi;
+                    minPhi = childPhi;
+                    bestIdx = i;
+                }
+                else if (childPhi < secondPhi)
+                    secondPhi = childPhi;
+
+                sumDelta = std::min<u32>(sumDelta + childDelta, INF);
+            }
+
+            phi = minPhi;
+            delta = sumDelta;
+
+            u32 thPhi = orNode ? thPn : thDn;
+            u32 thDelta = orNode ? thDn : thPn;
+
+            if (phi >= thPhi || delta >= thDelta || mStopped) break;
+
+            // The best child is searched until it stops being the best, or the node reaches its threshold
+            MateTable::Entry best = mateTable.probe(childKeys[bestIdx]);
+            u32 bestDelta = orNode ? best.dn : best.pn;
+
+            u32 thForPhi = std::min<u32>(thPhi, secondPhi == INF ? INF : secondPhi + 1);
+            u32 thForDelta = std::min<u64>((u64)thDelta - delta + bestDelta, INF);
+
+            mBoard.makeMove(moves[bestIdx]);
+
+            if (orNode)
+                mid(pliesLeft - 1, thForPhi, thForDelta);
+            else
+                mid(pliesLeft - 1, thForDelta, thForPhi);
+
+            mBoard.restore(state);
+        }
+
+        u32 work = std::min<u64>(mNodes - nodesBefore + 1, INF);
+        mateTable.store(key, orNode ? phi : delta, orNode ? delta : phi, work);
+    }
+
+    public:
+
+    inline MateSearch(const Board &board, u64 maxNodes, bool printInfo)
+    : mBoard(board), mAttacker(mBoard.sideToMove()), mRootHash(mBoard.zobristHash()), mMaxNodes(maxNodes), mPrintInfo(printInfo)
+    {
+        mStartTime = std::chrono::steady_clock::now();
+    }
+
+    inline u64 nodes() { return mNodes; }
+
+    inline bool stopped() { return mStopped; }
+
+    // true if the root is proven (mate in 'mateMoves' moves with checks only)
+    inline bool prove(int mateMoves)
+    {
+        mRootPlies = mateMoves * 2 - 1;
+        mid(mRootPlies, INF, INF);
+        return !mStopped && mateTable.probe(tableKey(mRootHash, mRootPlies)).pn == 0;
+    }
+
+    // Fewest plies (at most 'maxPlies') in which the attacker, to move, mates with checks only, or 0
+    inline int matePlies(int maxPlies)
+    {
+        for (int plies = 1; plies <= maxPlies && !mStopped; plies += 2)
+        {
+            mid(plies, INF, INF);
+
+            if (mateTable.probe(tableKey(mBoard.zobristHash(), plies)).pn == 0)
+                return plies;
+        }
+
+        return 0;
+    }
+
+    // Shortest mate against the longest defence, after prove() succeeded
+    inline void pv(std::vector<Move> &pv)
+    {
+        pv.clear();
+        Board::State rootState = mBoard.state();
+        int pliesLeft = mRootPlies;
+        MoveList moves;
+
+        while (pliesLeft > 0 && !mStopped)
+        {
+            bool orNode = mBoard.sideToMove() == mAttacker;
+            genMoves(moves);
+
+            Move bestMove = MOVE_NONE;
+            int bestPlies = 0;
+            Board::State state = mBoard.state();
+
+            for (Move move : moves)
+            {
+                mBoard.makeMove(move);
+
+                // Attacker: any check proven within the plies left, defender: the reply that delays the mate the most
+                int plies = orNode
+                    ? (mateTable.probe(tableKey(mBoard.zobristHash(), pliesLeft - 1)).pn == 0 ? pliesLeft - 1 : -1)
+                    : matePlies(pliesLeft - 1);
+
+                mBoard.restore(state);
+
+                if (plies > bestPlies || (bestMove == MOVE_NONE && plies >= 0)) {
+                    bestMove = move;
+                    bestPlies = plies;
+                }
+
+                if (orNode && bestMove != MOVE_NONE) break;
+            }
+
+            // A proof may have been overwritten in the table
+            if (bestMove == MOVE_NONE) break;
+
+            pv.push_back(bestMove);
+            mBoard.makeMove(bestMove);
+            pliesLeft = orNode ? pliesLeft - 1 : bestPlies;
+        }
+
+        mBoard.restore(rootState);
+    }
+
+    inline u64 elapsedMs() { return millisecondsElapsed(mStartTime); }
+
+}; // class MateSearch
+
+// Returns best move, ponder move (MOVE_NONE if unknown) and nodes, like the other searches
+// Without a mate, the attacker's most promising check (lowest pn) is returned, or the first legal move
+inline std::tuple<Move, Move, u64> search(const Board &rootBoard, TimeManager &timeManager, int mateMoves, u64 maxNodes, bool boolPrintInfo)
+{
+    ProcessSearchGuard guard;
+
+    if (!guard.acquired()) {
+        if (boolPrintInfo) std::cout << "info string another alpha-beta or mate search is running" << std::endl;
+        return {MOVE_NONE, MOVE_NONE, 0};
+    }
+
+    // Entries are exact for their position and plies left, so they're kept between searches until ucinewgame
+    if (mateTable.sizeMb() != mateTableMb) mateTable.resize(mateTableMb);
+
+    MateSearch mateSearch(rootBoard, maxNodes, boolPrintInfo);
+    timeManager.startWatchdog(stopSearch);
+
+    int provenMoves = 0;
+
+    for (int n = 1; n <= std::max(mateMoves, 1) && provenMoves == 0 && !mateSearch.stopped(); n++)
+        if (mateSearch.prove(n)) provenMoves = n;
+
+    timeManager.stopWatchdog();
+
+    std::vector<Move> pv;
+    u64 nodes = mateSearch.nodes();
+    u64 ms = mateSearch.elapsedMs();
+
+    if (provenMoves > 0)
+    {
+        mateSearch.pv(pv);
+
+        if (boolPrintInfo)
+        {
+            std::stringstream info;
+
+            info << "info depth " << provenMoves * 2 - 1
+                 << " nodes "     << nodes
+                 << " nps "       << nodes * 1000 / std::max<u64>(ms, 1)
+                 << " time "      << ms
+                 << " hashfull "  << mateTable.hashfull()
+                 << " score mate " << provenMoves
+                 << " pv";
+
+            for (Move move : pv)
+                info << " " << move.toUci();
+
+            std::cout << info.str() << std::endl;
+        }
+
+        return { pv[0], pv.size() > 1 ? pv[1] : MOVE_NONE, nodes };
+    }
+
+    if (boolPrintInfo)
+        std::cout << "info string no mate in " << mateMoves << " with checks only"
+                  << (mateSearch.stopped() ? " found before the search was stopped" : "")
+                  << std::endl;
+
+    Board board = rootBoard;
+    std::vector<Move> moves;
+    board.legalMoves(moves);
+
+    if (moves.size() == 0) return { MOVE_NONE, MOVE_NONE, nodes };
+
+    Move bestMove = moves[0];
+    u32 bestPn = INF + 1;
+    int pliesLeft = std::max(mateMoves, 1) * 2 - 2;
+    Board::State state = board.state();
+
+    for (Move move : moves)
+    {
+        if (!board.givesCheck(move)) continue;
+
+        board.makeMove(move);
+        u32 pn = mateTable.probe(tableKey(board.zobristHash(), pliesLeft)).pn;
+        board.restore(state);
+
+        if (pn < bestPn) {
+            bestPn = pn;
+            bestMove = move;
+        }
+    }
+
+    return { bestMove, MOVE_NONE, nodes };
+}
+
+} // namespace dfpn
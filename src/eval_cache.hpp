@@ -0,0 +1,97 @@
+// clang-format off
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include "types.hpp"
+
+constexpr u64 DEFAULT_EVAL_CACHE_MB = 16;
+
+// Leaf evaluations keyed by zobrist hash, shared by all searches of a game (owned by their search context)
+// Each entry is a single atomic u64 (48 bits of key, 16 bits of quantized WDL), so it's lock-free
+// and a torn entry can't happen; entries are grouped in buckets of one cache line
+// The bucket is picked by the hash's high bits and the key holds its low 48 bits, so the key doesn't repeat
+// the bucket index (up to 2^16 buckets, beyond that 64 - log2(buckets) bits are checked, the most a 64-bit hash allows)
+class EvalCache {
+    private:
+
+    constexpr static u64 ENTRIES_PER_BUCKET = 8;
+
+    struct alignas(64) Bucket {
+        std::array<std::atomic<u64>, ENTRIES_PER_BUCKET> mEntries;
+    };
+
+    static_assert(sizeof(Bucket) == 64);
+
+    std::unique_ptr<Bucket[]> mBuckets = nullptr;
+    u64 mNumBuckets = 0;
+
+    constexpr static u64 KEY_MASK = 0x0000'FFFF'FFFF'FFFFULL;
+
+    inline static u64 key(u64 hash) { return hash & KEY_MASK; }
+
+    inline static u64 entryKey(u64 data) { return data >> 16; }
+
+    inline Bucket& bucket(u64 hash) {
+        return mBuckets[(u128)hash * (u128)mNumBuckets >> 64];
+    }
+
+    public:
+
+    inline EvalCache(u64 sizeMb = DEFAULT_EVAL_CACHE_MB) { resize(sizeMb); }
+
+    inline void resize(u64 sizeMb)
+    {
+        mNumBuckets = std::max<u64>(sizeMb * 1024 * 1024 / sizeof(Bucket), 1);
+        mBuckets = std::make_unique<Bucket[]>(mNumBuckets);
+        clear();
+    }
+
+    inline void clear()
+    {
+        for (u64 i = 0; i < mNumBuckets; i++)
+            for (std::atomic<u64> &entry : mBuckets[i].mEntries)
+                entry.store(0, std::memory_order_relaxed);
+    }
+
+    // 'wdl' in [-1, 1], from the perspective of the side to move
+    // Hit rates are counted by the searches (per context), so probing writes nothing shared
+    inline bool probe(u64 hash, double &wdl)
+    {
+        for (std::atomic<u64> &entry : bucket(hash).mEntries)
+        {
+            u64 data = entry.load(std::memory_order_relaxed);
+
+            if (data != 0 && entryKey(data) == key(hash)) {
+                wdl = (double)(i16)(data & 0xFFFF) / 32767.0;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    // Replaces the entry with the same key, else an empty one, else one picked by the hash
+    inline void store(u64 hash, double wdl)
+    {
+        u64 data = key(hash) << 16 | (u16)(i16)round(wdl * 32767.0);
+        Bucket &bucket = this->bucket(hash);
+        std::atomic<u64> *replace = &bucket.mEntries[hash % ENTRIES_PER_BUCKET];
+
+        for (std::atomic<u64> &entry : bucket.mEntries)
+        {
+            u64 entryData = entry.load(std::memory_order_relaxed);
+
+            if (entryKey(entryData) == key(hash)) {
+                replace = &entry;
+                break;
+            }
+
+            if (entryData == 0) replace = &entry;
+        }
+
+        replace->store(data, std::memory_order_relaxed);
+    }
+
+}; // class EvalCache
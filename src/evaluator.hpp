@@ -0,0 +1,86 @@
+// clang-format off
+
+#pragma once
+
+#include "board.hpp"
+#include "search_params.hpp"
+
+// Centipawns to [-1, 1] through a sigmoid scaled by 'evalScale' (EVAL_SCALE)
+inline double evalToWdl(i32 eval, double evalScale)
+{
+    double wdl = 1.0 / (1.0 + exp(-eval / evalScale)); // [0, 1]
+    wdl *= 2; // [0, 2]
+    wdl -= 1; // [-1, 1]
+
+    assert(wdl >= -1 && wdl <= 1);
+    return wdl;
+}
+
+// Evaluates the leaves of the search in batches
+// Heavier evaluators (e.g. neural networks) can amortize their cost over a batch
+// Each search context owns its evaluators, which read that context's parameters
+class BatchEvaluator {
+    protected:
+
+    const SearchParams &mParams;
+
+    inline double evalToWdl(i32 eval) { return ::evalToWdl(eval, mParams.EVAL_SCALE()); }
+
+    public:
+
+    inline explicit BatchEvaluator(const SearchParams &params) : mParams(params) { }
+
+    virtual ~BatchEvaluator() = default;
+
+    // results[i] = WDL of boards[i] in [-1, 1], from the perspective of the side to move
+    // Only the first 'count' boards are evaluated, 'results' has room for them
+    virtual void evaluate(std::vector<Board> &boards, u64 count, std::vector<double> &results) = 0;
+
+}; // class BatchEvaluator
+
+// Material count with a little noise
+class MaterialEvaluator : public BatchEvaluator {
+    public:
+
+    Rng mRng;
+
+    using BatchEvaluator::BatchEvaluator;
+
+    inline double evaluate(Board &board)
+    {
+        constexpr std::array<int, 5> PIECE_VALUES = {100, 300, 315, 500, 900};
+        int eval = int(mRng.next() % 7) - 3;
+
+        for (int pieceType = PAWN; pieceType <= QUEEN; pieceType++)
+        {
+            u64 pieceBb = board.getBitboard((PieceType)pieceType);
+
+            int numPiecesDiff = std::popcount(board.us() & pieceBb) - std::popcount(board.them() & pieceBb);
+
+            eval += PIECE_VALUES[pieceType] * numPiecesDiff;
+        }
+
+        return evalToWdl(eval);
+    }
+
+    inline void evaluate(std::vector<Board> &boards, u64 count, std::vector<double> &results) override
+    {
+        for (u64 i = 0; i < count; i++)
+            results[i] = evaluate(boards[i]);
+    }
+
+}; // class MaterialEvaluator
+
+// NNUE value network, its accumulators are already up to date in the boards
+class NnueEvaluator : public BatchEvaluator {
+    public:
+
+    using BatchEvaluator::BatchEvaluator;
+
+    inline void evaluate(std::vector<Board> &boards, u64 count, std::vector<double> &results) override
+    {
+        for (u64 i = 0; i < count; i++)
+            results[i] = evalToWdl(boards[i].evaluate());
+    }
+
+}; // class NnueEvaluator
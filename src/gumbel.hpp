@@ -0,0 +1,123 @@
+// clang-format off
+
+#pragma once
+
+#include <numeric>
+#include "node.hpp"
+
+// Gumbel root search for a known budget of iterations (go nodes)
+// m root moves are sampled without replacement by Gumbel-top-k over the prior logits,
+// then sequential halving splits the budget into log2(m) phases: each phase visits the remaining candidates
+// equally, and only the better half (by gumbel + logit + sigma(Q)) goes on to the next one
+// Below the root, the usual selection is used
+class SequentialHalving {
+    private:
+
+    std::vector<u32> mCandidates = {};  // indices of the remaining root edges
+    std::vector<float> mGumbelLogits = {}; // [edge index] gumbel noise + prior logit
+    u64 mBudget = 0;
+    u64 mNumPhases = 1;
+    u32 mTarget = 0; // visits each remaining candidate gets by the end of the current phase
+    const SearchParams *mParams = nullptr;
+
+    // Visits per remaining candidate in a phase
+    inline u32 phaseVisits() {
+        return std::max<u64>(mBudget / (mNumPhases * mCandidates.size()), 1);
+    }
+
+    // Completed Q, scaled by the visits of the most visited candidate as in Gumbel MuZero
+    inline double score(Node &root, u32 edgeIdx, u32 maxVisits)
+    {
+        Edge &edge = root.mEdges[edgeIdx];
+
+        // Unvisited: the root's value, from the perspective of its side to move
+        double q = edge.mVisits > 0 || (edge.mChild != nullptr && edge.mChild->mGameState != GameState::ONGOING)
+                   ? edge.Q()
+                   : (root.mVisits > 0 ? -root.Q() : 0);
+
+        double sigma = (mParams->GUMBEL_C_VISIT() + maxVisits) * mParams->GUMBEL_C_SCALE() * (q + 1.0) / 2.0;
+
+        return mGumbelLogits[edgeIdx] + sigma;
+    }
+
+    inline void halve(Node &root)
+    {
+        u32 maxVisits = 0;
+
+        for (u32 idx : mCandidates)
+            maxVisits = std::max(maxVisits, root.mEdges[idx].mVisits);
+
+        std::stable_sort(mCandidates.begin(), mCandidates.end(), [&] (u32 a, u32 b) {
+            return score(root, a, maxVisits) > score(root, b, maxVisits);
+        });
+
+        mCandidates.resize((mCandidates.size() + 1) / 2);
+        mTarget += phaseVisits();
+    }
+
+    public:
+
+    // The number of candidates is lowered until every phase fits in the budget,
+    // with one iteration left for the last candidate so that it ends up the most visited
+    inline void init(Node &root, Board &board, u64 budget, const SearchParams &params)
+    {
+        mParams = &params;
+
+        if (params.PUCT() == 0) root.setPriors(board, params);
+
+        Rng rng;
+        rng.mX ^= board.zobristHash();
+
+        u64 numEdges = root.mEdges.size();
+        mGumbelLogits.resize(numEdges);
+
+        for (u64 i = 0; i < numEdges; i++) {
+            double uniform = std::max(rng.nextDouble(), 1e-12);
+            mGumbelLogits[i] = -log(-log(uniform)) + log(std::max(root.mEdges[i].prior(), 1e-6f));
+        }
+
+        mBudget = budget > 1 ? budget - 1 : 1;
+        u64 numCandidates = std::clamp<u64>(params.GUMBEL_M(), 1, numEdges);
+
+        while (numCandidates > 2 && numCandidates * (u64)ceil(log2(numCandidates)) > mBudget)
+            numCandidates--;
+
+        mNumPhases = std::max<u64>(ceil(log2(numCandidates)), 1);
+
+        // Gumbel-top-k: the candidates with the highest noisy logits
+        mCandidates.resize(numEdges);
+        std::iota(mCandidates.begin(), mCandidates.end(), 0);
+
+        std::partial_sort(mCandidates.begin(), mCandidates.begin() + numCandidates, mCandidates.end(),
+            [&] (u32 a, u32 b) { return mGumbelLogits[a] > mGumbelLogits[b]; });
+
+        mCandidates.resize(numCandidates);
+        mTarget = phaseVisits();
+    }
+
+    // Least visited candidate that hasn't reached the phase's target, halving when all have
+    // Proven losses count as done
+    inline Edge* select(Node &root)
+    {
+        while (true)
+        {
+            Edge *best = nullptr;
+
+            for (u32 idx : mCandidates)
+            {
+                Edge &edge = root.mEdges[idx];
+
+                if (edge.mVisits < mTarget && !Node::isProvenLoss(edge)
+                && (best == nullptr || edge.mVisits < best->mVisits))
+                    best = &edge;
+            }
+
+            if (best != nullptr) return best;
+
+            if (mCandidates.size() == 1) return &root.mEdges[mCandidates[0]];
+
+            halve(root);
+        }
+    }
+
+}; // class SequentialHalving
@@ -0,0 +1,148 @@
+// clang-format off
+
+#pragma once
+
+#include "evaluator.hpp"
+
+// Shallow alpha-beta (LEAF_SEARCH_DEPTH plies) and quiescence search from the leaf, with NNUE evals
+// Quiescence only searches captures and queen promotions that don't lose material (SEE), or every evasion in check
+// Moves are generated into stack MoveLists and undone with Board::State, so nothing is allocated
+class LeafSearchEvaluator : public BatchEvaluator {
+    private:
+
+    constexpr static i32 INF = 32000, MATE_SCORE = 30000;
+    constexpr static int MAX_QSEARCH_PLIES = 8;
+
+    // Hard limit, in check too: evasions that give check can otherwise chain without end (qsearch has no repetition check)
+    constexpr static int MAX_QSEARCH_CHECK_PLIES = 16;
+
+    // MVV-LVA for captures and promotions, 0 for quiets
+    inline static i32 moveScore(Board &board, Move move)
+    {
+        i32 score = 0;
+
+        if (board.isCapture(move))
+            score += 10 * SEE_PIECE_VALUES[(int)board.captured(move)] - SEE_PIECE_VALUES[(int)move.pieceType()] + 10000;
+
+        if (move.promotion() == PieceType::QUEEN)
+            score += 9000;
+
+        return score;
+    }
+
+    // Sorts the moves by score, best first (move lists are small)
+    inline static void sortMoves(Board &board, MoveList &moves, std::array<i32, 256> &scores)
+    {
+        for (u64 i = 0; i < moves.size(); i++)
+            scores[i] = moveScore(board, moves[i]);
+
+        for (u64 i = 1; i < moves.size(); i++)
+            for (u64 j = i; j > 0 && scores[j] > scores[j - 1]; j--) {
+                std::swap(scores[j], scores[j - 1]);
+                std::swap(moves[j], moves[j - 1]);
+            }
+    }
+
+    inline static i32 qsearch(Board &board, i32 alpha, i32 beta, int qply)
+    {
+        if (qply >= MAX_QSEARCH_CHECK_PLIES)
+            return board.evaluate();
+
+        bool inCheck = board.inCheck();
+        i32 bestScore = -INF;
+
+        if (!inCheck)
+        {
+            bestScore = board.evaluate();
+
+            if (bestScore >= beta || qply >= MAX_QSEARCH_PLIES)
+                return bestScore;
+
+            alpha = std::max(alpha, bestScore);
+        }
+
+        MoveList moves;
+        board.legalMoves(moves, false);
+
+        if (moves.size() == 0)
+            return inCheck ? -MATE_SCORE : 0;
+
+        std::array<i32, 256> scores;
+        sortMoves(board, moves, scores);
+
+        Board::State state = board.state();
+
+        for (u64 i = 0; i < moves.size(); i++)
+        {
+            // Only noisy moves that don't lose material, unless in check
+            if (!inCheck && (scores[i] == 0 || !board.SEE(moves[i], 0)))
+                continue;
+
+            board.makeMove(moves[i]);
+            i32 score = -qsearch(board, -beta, -alpha, qply + 1);
+            board.restore(state);
+
+            if (score > bestScore) {
+                bestScore = score;
+                alpha = std::max(alpha, score);
+
+                if (score >= beta) break;
+            }
+        }
+
+        // In check past MAX_QSEARCH_PLIES, every evasion was searched (up to MAX_QSEARCH_CHECK_PLIES)
+        return bestScore;
+    }
+
+    inline static i32 search(Board &board, int depth, i32 alpha, i32 beta, int ply)
+    {
+        if (ply > 0 && (board.insufficientMaterial() || board.fiftyMovesDraw() || board.isRepetition()))
+            return 0;
+
+        if (depth <= 0) return qsearch(board, alpha, beta, 0);
+
+        MoveList moves;
+        board.legalMoves(moves, false);
+
+        if (moves.size() == 0)
+            return board.inCheck() ? -MATE_SCORE : 0;
+
+        std::array<i32, 256> scores;
+        sortMoves(board, moves, scores);
+
+        Board::State state = board.state();
+        i32 bestScore = -INF;
+
+        for (Move move : moves)
+        {
+            board.makeMove(move);
+            i32 score = -search(board, depth - 1, -beta, -alpha, ply + 1);
+            board.restore(state);
+
+            if (score > bestScore) {
+                bestScore = score;
+                alpha = std::max(alpha, score);
+
+                if (score >= beta) break;
+            }
+        }
+
+        return bestScore;
+    }
+
+    public:
+
+    using BatchEvaluator::BatchEvaluator;
+
+    // Score in centipawns from the perspective of the side to move, the board is left unchanged
+    inline static i32 searchLeaf(Board &board, int depth) {
+        return search(board, depth, -INF, INF, 0);
+    }
+
+    inline void evaluate(std::vector<Board> &boards, u64 count, std::vector<double> &results) override
+    {
+        for (u64 i = 0; i < count; i++)
+            results[i] = evalToWdl(std::clamp<i32>(searchLeaf(boards[i], mParams.LEAF_SEARCH_DEPTH()), -MATE_SCORE, MATE_SCORE));
+    }
+
+}; // class LeafSearchEvaluator
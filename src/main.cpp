@@ -4,7 +4,12 @@
 #include "search.hpp"
 #include "uci.hpp"
 
-int main()
+#if defined(__unix__) || defined(__APPLE__)
+    #include "server.hpp"
+#endif
+
+// "server <socket path> [workers]" serves many UCI sessions over a Unix domain socket, otherwise UCI on stdin
+int main(int argc, char* argv[])
 {
     std::cout << "New Century by zzzzz" << std::endl;
 
@@ -20,6 +25,14 @@ int main()
     attacks::init();
     initUtils();
     
+    #if defined(__unix__) || defined(__APPLE__)
+        if (argc >= 3 && std::string(argv[1]) == "server") {
+            u64 numWorkers = argc >= 4 ? std::stoull(argv[3]) : std::thread::hardware_concurrency();
+            server::serve(argv[2], numWorkers);
+            return 0;
+        }
+    #endif
+
     uci::uciLoop();
 
     return 0;
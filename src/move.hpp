@@ -46,6 +46,9 @@ struct Move {
         moveEncoded |= flag;
     }
 
+    // From encoded(), e.g. a move stored in the transposition table
+    inline explicit Move(u16 encoded) : moveEncoded(encoded) { }
+
     inline u16 encoded() { return moveEncoded; }
 
     inline Square from() { return (moveEncoded >> 10) & 0b111111; }
@@ -95,3 +98,48 @@ struct Move {
 
 constexpr Move MOVE_NONE = Move();
 
+// Move encoding of the output files (analyse, datagen), independent of the internal one:
+// from square (a1 = 0, h8 = 63) | to square << 6 | promotion << 12 (0 none, 1 N, 2 B, 3 R, 4 Q)
+inline u16 packMove(Move move)
+{
+    PieceType promotion = move.promotion();
+
+    u16 promotionBits = promotion == PieceType::KNIGHT ? 1
+                      : promotion == PieceType::BISHOP ? 2
+                      : promotion == PieceType::ROOK   ? 3
+                      : promotion == PieceType::QUEEN  ? 4
+                      : 0;
+
+    return (u16)move.from() | ((u16)move.to() << 6) | (promotionBits << 12);
+}
+
+// Fixed capacity move buffer, so that move generation doesn't allocate
+// 256 is above the maximum number of legal moves in a chess position (218)
+struct MoveList {
+    private:
+
+    std::array<Move, 256> mMoves;
+    u32 mSize = 0;
+
+    public:
+
+    inline void push_back(Move move) {
+        assert(mSize < mMoves.size());
+        mMoves[mSize++] = move;
+    }
+
+    inline void clear() { mSize = 0; }
+
+    inline u64 size() const { return mSize; }
+
+    inline Move& operator[](u64 i) {
+        assert(i < mSize);
+        return mMoves[i];
+    }
+
+    inline Move* begin() { return mMoves.data(); }
+
+    inline Move* end() { return mMoves.data() + mSize; }
+
+}; // struct MoveList
+
@@ -0,0 +1,305 @@
+// clang-format off
+
+// C API of the engine (newcentury.h), built as libnewcentury
+
+#include <cstring>
+#include <mutex>
+#include "newcentury.h"
+#include "search.hpp"
+
+struct nc_engine {
+    public:
+
+    SearchContext mContext;
+
+    // For nc_stop(): the contexts searching, and whether a stop is pending
+    // A stop is only cleared when a search call ends, so one that arrives just before a call starts isn't lost
+    std::mutex mMutex;
+    std::vector<SearchContext*> mRunning = {};
+    bool mStopped = false;
+
+    // Analysis gets its whole budget: smart pruning, which would end searches early
+    // and truncate visits and PVs, is off unless set with nc_engine_set_param()
+    inline nc_engine(u64 evalCacheMb) : mContext(SearchParams(), evalCacheMb)
+    {
+        mContext.setOutput(nullptr);
+        mContext.params().SMART_PRUNING.value = 0;
+    }
+
+}; // struct nc_engine
+
+namespace capi {
+
+// Attack tables, zobrist keys and castling tables, shared by every engine
+inline void initOnce()
+{
+    static std::once_flag initialized;
+
+    std::call_once(initialized, [] () {
+        initZobrist();
+        attacks::init();
+        initUtils();
+    });
+}
+
+inline void copyMove(Move move, char *out) {
+    std::string uci = move == MOVE_NONE ? "" : move.toUci();
+    std::strncpy(out, uci.c_str(), NC_MOVE_CHARS - 1);
+    out[NC_MOVE_CHARS - 1] = '\0';
+}
+
+inline bool hasLimit(const nc_limits &limits) {
+    return limits.max_nodes > 0 || limits.max_depth > 0 || limits.move_time_ms > 0;
+}
+
+// Registers a context in the engine while it searches, so that nc_stop() reaches it, even if the search throws
+class RunningSearch {
+    private:
+
+    nc_engine &mEngine;
+    SearchContext &mContext;
+    bool mRegistered = false;
+
+    public:
+
+    inline RunningSearch(nc_engine &engine, SearchContext &context) : mEngine(engine), mContext(context) { }
+
+    // Returns false if the engine was stopped, then the context isn't registered
+    inline bool start()
+    {
+        std::lock_guard<std::mutex> lock(mEngine.mMutex);
+
+        if (mEngine.mStopped) return false;
+
+        mEngine.mRunning.push_back(&mContext);
+        mRegistered = true;
+        return true;
+    }
+
+    inline ~RunningSearch()
+    {
+        if (!mRegistered) return;
+
+        std::lock_guard<std::mutex> lock(mEngine.mMutex);
+        mEngine.mRunning.erase(std::find(mEngine.mRunning.begin(), mEngine.mRunning.end(), &mContext));
+    }
+
+}; // class RunningSearch
+
+// Called when a search call (nc_analyse, nc_analyse_batch) ends, its searches are over
+inline void clearStop(nc_engine &engine)
+{
+    std::lock_guard<std::mutex> lock(engine.mMutex);
+    engine.mStopped = false;
+}
+
+// Searches with 'context', which is registered in the engine while searching so that nc_stop() reaches it
+inline void analyse(nc_engine &engine, SearchContext &context, const char *fen, const nc_limits &limits, nc_result &result)
+{
+    result = {};
+
+    if (fen == nullptr || !isValidFen(fen)) {
+        result.error = NC_ERROR_INVALID_FEN;
+        return;
+    }
+
+    Board board = Board(fen);
+
+    MoveList moves;
+    board.legalMoves(moves, false);
+
+    if (moves.size() == 0) {
+        result.error = NC_ERROR_NO_LEGAL_MOVES;
+        return;
+    }
+
+    context.clearStop();
+    RunningSearch running(engine, context);
+
+    if (!running.start()) {
+        result.error = NC_ERROR_STOPPED;
+        return;
+    }
+
+    SearchLimits searchLimits;
+    searchLimits.maxNodes = limits.max_nodes > 0 ? limits.max_nodes : I64_MAX;
+    searchLimits.maxDepth = limits.max_depth > 0 ? limits.max_depth : I64_MAX;
+
+    if (limits.hash_mb > 0) searchLimits.hashMb = limits.hash_mb;
+
+    TimeManager timeManager;
+    i64 moveTimeMs = limits.move_time_ms > 0 ? limits.move_time_ms : I64_MAX;
+    timeManager.init(I64_MAX, I64_MAX, 0, moveTimeMs, 0, false);
+
+    auto [bestMove, ponderMove, nodes] = context.search(board, timeManager, searchLimits);
+
+    Node &root = context.root();
+    Edge *bestEdge = root.bestEdge();
+
+    copyMove(bestMove, result.best_move);
+    copyMove(ponderMove, result.ponder_move);
+    result.nodes = nodes;
+    result.visits = bestEdge->mVisits;
+
+    bool isMate;
+    i32 score = root.score(context.params(), isMate);
+    (isMate ? result.mate : result.score_cp) = score;
+
+    std::vector<Move> pv;
+    Node::pv(*bestEdge, pv, NC_MAX_PV);
+
+    result.pv_length = pv.size();
+
+    for (u64 i = 0; i < pv.size(); i++)
+        copyMove(pv[i], result.pv[i]);
+
+    context.releaseTree();
+}
+
+// Exceptions (out of memory, no more threads) must not cross the C boundary
+inline void analyseNoThrow(nc_engine &engine, SearchContext &context, const char *fen, const nc_limits &limits, nc_result &result)
+{
+    try {
+        analyse(engine, context, fen, limits, result);
+    }
+    catch (...) {
+        result = {};
+        result.error = NC_ERROR_INTERNAL;
+        context.releaseTree();
+    }
+}
+
+} // namespace capi
+
+extern "C" {
+
+NC_API int nc_api_version(void) { return NC_API_VERSION; }
+
+NC_API nc_engine* nc_engine_new(uint64_t eval_cache_mb)
+{
+    try {
+        capi::initOnce();
+        return new nc_engine(eval_cache_mb > 0 ? eval_cache_mb : DEFAULT_EVAL_CACHE_MB);
+    }
+    catch (...) {
+        return nullptr;
+    }
+}
+
+NC_API void nc_engine_free(nc_engine *engine) { delete engine; }
+
+NC_API int nc_engine_set_param(nc_engine *engine, const char *name, double value)
+{
+    if (engine == nullptr || name == nullptr) return NC_ERROR_INVALID_ARGUMENT;
+
+    try {
+        auto tunableParams = engine->mContext.params().tunableParams();
+
+        if (tunableParams.count(name) == 0) return NC_ERROR_INVALID_ARGUMENT;
+
+        std::visit([value] (auto *myParam) {
+            myParam->value = std::is_integral<decltype(myParam->value)>::value ? round(value) : value;
+        }, tunableParams[name]);
+
+        return NC_OK;
+    }
+    catch (...) {
+        return NC_ERROR_INTERNAL;
+    }
+}
+
+NC_API void nc_engine_clear(nc_engine *engine)
+{
+    if (engine != nullptr) engine->mContext.evalCache().clear();
+}
+
+NC_API void nc_stop(nc_engine *engine)
+{
+    if (engine == nullptr) return;
+
+    try {
+        std::lock_guard<std::mutex> lock(engine->mMutex);
+        engine->mStopped = true;
+
+        for (SearchContext *context : engine->mRunning)
+            context->stop();
+    }
+    catch (...) { }
+}
+
+NC_API int nc_analyse(nc_engine *engine, const char *fen, const nc_limits *limits, nc_result *result)
+{
+    if (engine == nullptr || limits == nullptr || result == nullptr || !capi::hasLimit(*limits))
+        return NC_ERROR_INVALID_ARGUMENT;
+
+    capi::analyseNoThrow(*engine, engine->mContext, fen, *limits, *result);
+
+    try {
+        capi::clearStop(*engine);
+    }
+    catch (...) { }
+
+    return result->error;
+}
+
+NC_API int nc_analyse_batch(nc_engine *engine, const char *const *fens, size_t count, const nc_limits *limits,
+    size_t num_threads, nc_result *results)
+{
+    if (engine == nullptr || fens == nullptr || limits == nullptr || results == nullptr || !capi::hasLimit(*limits))
+        return NC_ERROR_INVALID_ARGUMENT;
+
+    // The tree memory is split between the threads
+    size_t numThreads = std::max<size_t>(std::min(num_threads, count), 1);
+    nc_limits threadLimits = *limits;
+    threadLimits.hash_mb = std::max<u64>((limits->hash_mb > 0 ? limits->hash_mb : DEFAULT_HASH_MB) / numThreads, 1);
+
+    // Each thread takes the next position, so long searches don't leave threads idle
+    std::atomic<size_t> next = 0;
+
+    auto searchPositions = [&] (SearchContext &context) {
+        for (size_t i = next++; i < count; i = next++)
+            capi::analyseNoThrow(*engine, context, fens[i], threadLimits, results[i]);
+    };
+
+    try {
+        std::vector<std::thread> threads;
+
+        // If fewer threads than asked can be started, the started ones search all the positions
+        try {
+            for (size_t t = 0; numThreads > 1 && t < numThreads; t++)
+                threads.emplace_back([&] ()
+                {
+                    try {
+                        SearchContext context(engine->mContext.params(), engine->mContext.evalCache());
+                        context.setOutput(nullptr);
+                        searchPositions(context);
+                    }
+                    catch (...) { } // no context: the other threads (or the calling thread) take the positions
+                });
+        }
+        catch (...) { }
+
+        // Single threaded, or no thread could be started
+        if (threads.size() == 0)
+            searchPositions(engine->mContext);
+
+        for (std::thread &thread : threads)
+            thread.join();
+    }
+    catch (...) { }
+
+    // Positions no thread could search
+    for (size_t i = next; i < count; i++) {
+        results[i] = {};
+        results[i].error = NC_ERROR_INTERNAL;
+    }
+
+    try {
+        capi::clearStop(*engine);
+    }
+    catch (...) { }
+
+    return NC_OK;
+}
+
+} // extern "C"
@@ -0,0 +1,98 @@
+// clang-format off
+
+// libnewcentury: C API of the MCTS engine, for embedding it without the UCI text protocol
+// Build: see "C library" in README.md
+
+#ifndef NEWCENTURY_H
+#define NEWCENTURY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(__GNUC__)
+    #define NC_API __attribute__((visibility("default")))
+#else
+    #define NC_API
+#endif
+
+// Incremented when the structs or functions change incompatibly
+#define NC_API_VERSION 1
+
+#define NC_MOVE_CHARS 6 // UCI move ("e7e8q") and the terminating null
+#define NC_MAX_PV 64
+
+// Error codes
+#define NC_OK 0
+#define NC_ERROR_INVALID_ARGUMENT 1 // null pointer, no limit, unknown parameter
+#define NC_ERROR_INVALID_FEN 2
+#define NC_ERROR_NO_LEGAL_MOVES 3   // checkmate or stalemate
+#define NC_ERROR_STOPPED 4          // nc_stop() was called before the position was searched
+#define NC_ERROR_INTERNAL 5         // out of memory, or no thread could be started; no C++ exception leaves the library
+
+// An engine owns an MCTS search context (parameters, tree, eval cache)
+// Its functions must not be called from two threads at once, except nc_stop()
+// Different engines are independent and can be used from different threads
+typedef struct nc_engine nc_engine;
+
+// 0 = not set, at least one of nodes, depth and time must be set
+typedef struct nc_limits {
+    uint64_t max_nodes;    // MCTS iterations
+    uint64_t max_depth;    // average depth of the iterations
+    uint64_t move_time_ms;
+    uint64_t hash_mb;      // tree memory, 0 = engine default; a batch splits it between its threads
+} nc_limits;
+
+typedef struct nc_result {
+    int32_t error;                   // NC_OK or an NC_ERROR_ code, the other fields are only set if NC_OK
+    char best_move[NC_MOVE_CHARS];   // UCI notation
+    char ponder_move[NC_MOVE_CHARS]; // "" if unknown
+    int32_t score_cp;                // for the side to move, 0 if mate != 0
+    int32_t mate;                    // moves to mate, negative if the side to move gets mated, 0 = no mate found
+    uint64_t nodes;                  // MCTS iterations
+    uint32_t visits;                 // visits of the best move
+    uint32_t pv_length;
+    char pv[NC_MAX_PV][NC_MOVE_CHARS];
+} nc_result;
+
+NC_API int nc_api_version(void);
+
+// eval_cache_mb = 0 for the default size
+// Returns null if out of memory
+NC_API nc_engine* nc_engine_new(uint64_t eval_cache_mb);
+
+NC_API void nc_engine_free(nc_engine *engine);
+
+// Sets a tunable search parameter by its UCI option name (e.g. "UCT_C", "PUCT")
+// Unlike in UCI play, SMART_PRUNING is 0 by default, so that searches use their whole node or time limit
+// 'value' is the parameter's value itself, not the x100 integer of the UCI option
+NC_API int nc_engine_set_param(nc_engine *engine, const char *name, double value);
+
+// Clears the eval cache, e.g. between unrelated games
+NC_API void nc_engine_clear(nc_engine *engine);
+
+// Thread safe: ends the search in progress (its result is still returned),
+// and the positions of a batch that haven't started get NC_ERROR_STOPPED
+// A stop stays pending until the current (or, if none is running, the next) nc_analyse/nc_analyse_batch call returns,
+// so a stop racing with the start of a call is never lost
+NC_API void nc_stop(nc_engine *engine);
+
+// Searches a position given by FEN
+// Returns the result's error code
+NC_API int nc_analyse(nc_engine *engine, const char *fen, const nc_limits *limits, nc_result *result);
+
+// Searches 'count' positions with the same limits, on 'num_threads' threads (0 or 1 = the calling thread)
+// Each thread has its own tree, all share the engine's parameters and eval cache
+// results[i] is the result of fens[i]; returns NC_OK, or NC_ERROR_INVALID_ARGUMENT without searching
+// If fewer threads than asked can be started, the started ones (or the calling thread) search all the positions
+NC_API int nc_analyse_batch(nc_engine *engine, const char *const *fens, size_t count, const nc_limits *limits,
+    size_t num_threads, nc_result *results);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // NEWCENTURY_H
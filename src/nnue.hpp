@@ -0,0 +1,190 @@
+// clang-format off
+
+#pragma once
+
+#if defined(__AVX512F__) && defined(__AVX512BW__) || defined(__AVX2__)
+    #include <immintrin.h>
+#endif
+
+#include "types.hpp"
+#include "utils.hpp"
+#include "3rdparty/incbin.h"
+
+// (768 -> HIDDEN_SIZE) x 2 -> 1
+// Features are (piece color relative to the perspective, piece type, square flipped for black)
+// Both perspectives share the feature weights; the output weights differ for the side to move and the other side
+
+#if !defined(EVALFILE)
+    #define EVALFILE "src/net.nnue"
+#endif
+
+INCBIN(NetFile, EVALFILE);
+
+namespace nnue {
+
+constexpr int HIDDEN_SIZE = 64;
+constexpr i32 QA = 255, QB = 64; // quantization of the feature and output weights
+constexpr i32 SCALE = 400;
+
+struct alignas(64) Net {
+    MultiArray<i16, 768, HIDDEN_SIZE> featureWeights;
+    std::array<i16, HIDDEN_SIZE>      featureBiases;
+    MultiArray<i16, 2, HIDDEN_SIZE>   outputWeights; // [0 = side to move, 1 = other side]
+    i16                               outputBias;
+};
+
+const Net *NET = reinterpret_cast<const Net*>(gNetFileData);
+
+#if defined(__AVX512F__) && defined(__AVX512BW__)
+    using Vec = __m512i;
+
+    inline Vec vecLoad(const i16 *ptr)        { return _mm512_load_si512(ptr); }
+    inline void vecStore(i16 *ptr, Vec v)     { _mm512_store_si512(ptr, v); }
+    inline Vec vecAdd16(Vec a, Vec b)         { return _mm512_add_epi16(a, b); }
+    inline Vec vecSub16(Vec a, Vec b)         { return _mm512_sub_epi16(a, b); }
+    inline Vec vecSet16(i16 x)                { return _mm512_set1_epi16(x); }
+    inline Vec vecZero()                      { return _mm512_setzero_si512(); }
+    inline Vec vecMin16(Vec a, Vec b)         { return _mm512_min_epi16(a, b); }
+    inline Vec vecMax16(Vec a, Vec b)         { return _mm512_max_epi16(a, b); }
+    inline Vec vecMadd16(Vec a, Vec b)        { return _mm512_madd_epi16(a, b); }
+    inline Vec vecAdd32(Vec a, Vec b)         { return _mm512_add_epi32(a, b); }
+
+    inline i32 vecReduceAdd32(Vec v) {
+        __m256i sum256 = _mm256_add_epi32(_mm512_castsi512_si256(v), _mm512_extracti64x4_epi64(v, 1));
+        __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(sum256), _mm256_extracti128_si256(sum256, 1));
+        sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0b01001110));
+        sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0b10110001));
+        return _mm_cvtsi128_si32(sum);
+    }
+#elif defined(__AVX2__)
+    using Vec = __m256i;
+
+    inline Vec vecLoad(const i16 *ptr)        { return _mm256_load_si256((const __m256i*)ptr); }
+    inline void vecStore(i16 *ptr, Vec v)     { _mm256_store_si256((__m256i*)ptr, v); }
+    inline Vec vecAdd16(Vec a, Vec b)         { return _mm256_add_epi16(a, b); }
+    inline Vec vecSub16(Vec a, Vec b)         { return _mm256_sub_epi16(a, b); }
+    inline Vec vecSet16(i16 x)                { return _mm256_set1_epi16(x); }
+    inline Vec vecZero()                      { return _mm256_setzero_si256(); }
+    inline Vec vecMin16(Vec a, Vec b)         { return _mm256_min_epi16(a, b); }
+    inline Vec vecMax16(Vec a, Vec b)         { return _mm256_max_epi16(a, b); }
+    inline Vec vecMadd16(Vec a, Vec b)        { return _mm256_madd_epi16(a, b); }
+    inline Vec vecAdd32(Vec a, Vec b)         { return _mm256_add_epi32(a, b); }
+
+    inline i32 vecReduceAdd32(Vec v) {
+        __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+        sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0b01001110));
+        sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0b10110001));
+        return _mm_cvtsi128_si32(sum);
+    }
+#endif
+
+#if defined(__AVX512F__) && defined(__AVX512BW__) || defined(__AVX2__)
+    constexpr int VEC_SIZE = sizeof(Vec) / sizeof(i16);
+    static_assert(HIDDEN_SIZE % VEC_SIZE == 0);
+#endif
+
+inline int featureIndex(Color perspective, Color color, PieceType pieceType, Square square)
+{
+    if (perspective == Color::BLACK) square ^= 56;
+
+    return (color == perspective ? 0 : 384) + (int)pieceType * 64 + (int)square;
+}
+
+// Hidden layer of both perspectives, updated incrementally as pieces are placed and removed
+struct alignas(64) Accumulator {
+    public:
+
+    MultiArray<i16, 2, HIDDEN_SIZE> mValues; // [perspective]
+
+    inline void reset() {
+        mValues[WHITE] = mValues[BLACK] = NET->featureBiases;
+    }
+
+    template<bool ADD>
+    inline void update(Color color, PieceType pieceType, Square square)
+    {
+        for (Color perspective : { Color::WHITE, Color::BLACK })
+        {
+            i16 *values = mValues[(int)perspective].data();
+            const i16 *weights = NET->featureWeights[featureIndex(perspective, color, pieceType, square)].data();
+
+            #if defined(__AVX512F__) && defined(__AVX512BW__) || defined(__AVX2__)
+                for (int i = 0; i < HIDDEN_SIZE; i += VEC_SIZE) {
+                    Vec v = ADD ? vecAdd16(vecLoad(values + i), vecLoad(weights + i))
+                                : vecSub16(vecLoad(values + i), vecLoad(weights + i));
+                    vecStore(values + i, v);
+                }
+            #else
+                for (int i = 0; i < HIDDEN_SIZE; i++)
+                    values[i] += ADD ? weights[i] : -weights[i];
+            #endif
+        }
+    }
+
+}; // struct Accumulator
+
+// Sum of clipped ReLU(accumulator) * output weights
+inline i32 forward(const std::array<i16, HIDDEN_SIZE> &values, const std::array<i16, HIDDEN_SIZE> &weights)
+{
+    #if defined(__AVX512F__) && defined(__AVX512BW__) || defined(__AVX2__)
+        Vec sum = vecZero();
+
+        for (int i = 0; i < HIDDEN_SIZE; i += VEC_SIZE) {
+            Vec clipped = vecMin16(vecMax16(vecLoad(values.data() + i), vecZero()), vecSet16(QA));
+            sum = vecAdd32(sum, vecMadd16(clipped, vecLoad(weights.data() + i)));
+        }
+
+        return vecReduceAdd32(sum);
+    #else
+        i32 sum = 0;
+
+        for (int i = 0; i < HIDDEN_SIZE; i++)
+            sum += std::clamp<i32>(values[i], 0, QA) * weights[i];
+
+        return sum;
+    #endif
+}
+
+// Clipped ReLU of a perspective's hidden layer, for heads that reuse it many times
+inline void clippedHidden(const Accumulator &accumulator, Color perspective, std::array<i16, HIDDEN_SIZE> &hidden)
+{
+    const std::array<i16, HIDDEN_SIZE> &values = accumulator.mValues[(int)perspective];
+
+    #if defined(__AVX512F__) && defined(__AVX512BW__) || defined(__AVX2__)
+        for (int i = 0; i < HIDDEN_SIZE; i += VEC_SIZE)
+            vecStore(hidden.data() + i, vecMin16(vecMax16(vecLoad(values.data() + i), vecZero()), vecSet16(QA)));
+    #else
+        for (int i = 0; i < HIDDEN_SIZE; i++)
+            hidden[i] = std::clamp<i16>(values[i], 0, QA);
+    #endif
+}
+
+inline i32 dot(const std::array<i16, HIDDEN_SIZE> &a, const std::array<i16, HIDDEN_SIZE> &b)
+{
+    #if defined(__AVX512F__) && defined(__AVX512BW__) || defined(__AVX2__)
+        Vec sum = vecZero();
+
+        for (int i = 0; i < HIDDEN_SIZE; i += VEC_SIZE)
+            sum = vecAdd32(sum, vecMadd16(vecLoad(a.data() + i), vecLoad(b.data() + i)));
+
+        return vecReduceAdd32(sum);
+    #else
+        i32 sum = 0;
+
+        for (int i = 0; i < HIDDEN_SIZE; i++)
+            sum += (i32)a[i] * (i32)b[i];
+
+        return sum;
+    #endif
+}
+
+// Centipawns from the perspective of the side to move
+inline i32 evaluate(const Accumulator &accumulator, Color sideToMove)
+{
+    i32 sum = forward(accumulator.mValues[(int)sideToMove], NET->outputWeights[0])
+            + forward(accumulator.mValues[(int)oppColor(sideToMove)], NET->outputWeights[1]);
+
+    return (sum + NET->outputBias) * SCALE / (QA * QB);
+}
+
+} // namespace nnue
@@ -0,0 +1,601 @@
+// clang-format off
+
+#pragma once
+
+#include <optional>
+#include "board.hpp"
+#include "search_params.hpp"
+#include "policy.hpp"
+
+struct Node;
+
+// Butterfly history [color][from][to]
+// Running average of the backpropagated results of each move, shared by the whole tree
+struct History {
+    public:
+
+    MultiArray<float, 2, 64, 64> mTable = {};
+
+    constexpr static float UPDATE_RATE = 1.0 / 16.0;
+
+    inline float get(Color color, Move move) {
+        return mTable[(int)color][move.from()][move.to()];
+    }
+
+    inline void update(Color color, Move move, double result) {
+        float &entry = mTable[(int)color][move.from()][move.to()];
+        entry += UPDATE_RATE * (result - entry);
+    }
+
+    inline void clear() { mTable = {}; }
+
+}; // struct History
+
+struct Edge {
+    public:
+
+    Node *mChild = nullptr;
+    u32 mVisits = 0;
+    float mResultsSum = 0; // from the perspective of the side to move in the parent
+    u16 mPrior = 0; // quantized, see prior()
+    Move mMove = MOVE_NONE;
+
+    // RAVE: results of the iterations where this move was played later in the path by the same side
+    u32 mAmafVisits = 0;
+    float mAmafResultsSum = 0; // from the perspective of the side to move in the parent
+
+    inline Edge(Move move) : mMove(move) { }
+
+    inline float prior() { return (float)mPrior / 65535.0f; }
+
+    inline void setPrior(float prior) { mPrior = round(std::clamp<float>(prior, 0, 1) * 65535.0f); }
+
+    inline double Q();
+
+    inline double raveQ(const SearchParams &params);
+
+    inline double selectionQ(const SearchParams &params);
+
+    // Batched search: a selected edge counts as a lost visit until its leaf is evaluated,
+    // so that the other paths of the batch avoid it
+    inline void addVirtualLoss() {
+        mVisits++;
+        mResultsSum -= 1;
+    }
+
+    inline void removeVirtualLoss() {
+        mVisits--;
+        mResultsSum += 1;
+    }
+
+}; // struct Edge
+
+struct Node {
+    public:
+
+    std::vector<Edge> mEdges = {};
+    GameState mGameState = GameState::ONGOING;
+    bool mPendingEval = false; // batched search: created this batch, waiting for its evaluation
+    u32 mVisits = 0;
+    float mResultsSum = 0; // from the perspective of the side that moved into this node
+    u16 mNumExpanded = 0;
+    u16 mProvenPlies = 0; // plies to the end of the game if the node is won, lost or drawn
+    u32 mGcEpoch = 0; // last garbage collection that reached this node
+    u64 mKey = 0; // node table key in DAG mode
+    float mMinimax = 0; // implicit minimax of the leaf evals below, from the perspective of the side that moved into this node
+
+    inline Node() = default;
+
+    // In DAG mode, a node may be reached through different move sequences (and halfmove clocks),
+    // so path-dependent draws (repetitions, 50 moves) are handled by the search, not stored in the node
+    inline Node(Board &board, bool isRoot, bool checkPathDraws, History &history, const SearchParams &params)
+    {
+        MoveList moves;
+
+        if (isRoot) {
+            mGameState = GameState::ONGOING;
+            board.legalMoves(moves, false);
+            assert(moves.size() > 0);
+        }
+        else if (board.insufficientMaterial() || (checkPathDraws && board.isRepetition()))
+            mGameState = GameState::DRAW;
+        else {
+            board.legalMoves(moves, false);
+
+            mGameState = moves.size() == 0
+                         ? (board.inCheck() ? GameState::LOST : GameState::DRAW)
+                         : checkPathDraws && board.fiftyMovesDraw()
+                         ? GameState::DRAW
+                         : GameState::ONGOING;
+        }
+
+        // Best moves first, so that progressive widening exposes them first
+        std::vector<std::pair<float, Move>> scoredMoves;
+        scoredMoves.reserve(moves.size());
+
+        for (Move move : moves)
+            scoredMoves.push_back({ moveOrderingScore(board, move, history), move });
+
+        std::stable_sort(scoredMoves.begin(), scoredMoves.end(), 
+            [](auto &a, auto &b) { return a.first > b.first; });
+
+        mEdges.reserve(scoredMoves.size());
+        for (auto [score, move] : scoredMoves)
+            mEdges.push_back(Edge(move));
+
+        if (params.MCTS_SOLVER() > 0 && mGameState == GameState::ONGOING)
+            findMateInOne(board);
+
+        if (params.PUCT() > 0 && mEdges.size() > 0) 
+            setPriors(board, params);
+    }
+
+    // Root only: keep the edges of the given moves (go searchmoves)
+    // Ignored if none of them is legal
+    inline void restrictMoves(Board &board, const std::vector<Move> &moves, const SearchParams &params)
+    {
+        auto notSearched = [&] (Edge &edge) {
+            return std::find(moves.begin(), moves.end(), edge.mMove) == moves.end();
+        };
+
+        if (std::all_of(mEdges.begin(), mEdges.end(), notSearched)) return;
+
+        mEdges.erase(std::remove_if(mEdges.begin(), mEdges.end(), notSearched), mEdges.end());
+
+        // A mate in one found among all the moves may have been removed
+        mGameState = GameState::ONGOING;
+        mProvenPlies = 0;
+
+        if (params.MCTS_SOLVER() > 0)
+            findMateInOne(board);
+
+        if (params.PUCT() > 0)
+            setPriors(board, params);
+    }
+
+    // Promotions, then MVV-LVA captures, with a bonus for checks, and quiets by history
+    inline static float moveOrderingScore(Board &board, Move move, History &history)
+    {
+        float score = history.get(board.sideToMove(), move); // [-1, 1]
+
+        if (move.promotion() == PieceType::QUEEN)
+            score += 4.0;
+
+        if (board.isCapture(move))
+            score += 2.0 + (int)board.captured(move) * 0.2 - (int)move.pieceType() * 0.02;
+
+        if (board.givesCheck(move))
+            score += 1.5;
+
+        return score;
+    }
+
+    // Number of edges exposed with this many visits when progressive widening is enabled
+    inline u64 wideningLimit(const SearchParams &params) {
+        if (params.PROGRESSIVE_WIDENING() == 0) return mEdges.size();
+
+        u64 limit = ceil(params.PW_C() * pow((double)mVisits + 1.0, params.PW_EXPONENT()));
+        return std::clamp<u64>(limit, 1, mEdges.size());
+    }
+
+    // Cheap move score (captures by SEE and victim, promotions, checks)
+    inline static float heuristicLogit(Board &board, Move move)
+    {
+        float logit = 0;
+
+        if (board.isCapture(move))
+            logit += board.SEE(move) 
+                     ? 1.0 + (float)SEE_PIECE_VALUES[(int)board.captured(move)] / 900.0 
+                     : -0.5;
+
+        if (move.promotion() == PieceType::QUEEN)
+            logit += 1.5;
+
+        if (board.givesCheck(move))
+            logit += 1.0;
+
+        return logit;
+    }
+
+    // Softmax over the heuristic and policy network logits (uniform if both are disabled)
+    inline void setPriors(Board &board, const SearchParams &params)
+    {
+        if (params.HEURISTIC_PRIORS() == 0 && params.POLICY_NET() == 0) {
+            for (Edge &edge : mEdges)
+                edge.setPrior(1.0 / (double)mEdges.size());
+
+            return;
+        }
+
+        // Reused between nodes
+        thread_local std::vector<float> logits;
+        logits.resize(mEdges.size());
+
+        // Its hidden layer is only computed if the policy is used
+        std::optional<policy::PolicyHead> policyHead;
+
+        if (params.POLICY_NET() > 0)
+            policyHead.emplace(board.accumulator(), board.sideToMove());
+
+        float maxLogit = -1000;
+
+        for (u64 i = 0; i < mEdges.size(); i++)
+        {
+            logits[i] = (params.HEURISTIC_PRIORS() > 0 ? heuristicLogit(board, mEdges[i].mMove) : 0)
+                      + (policyHead ? policyHead->logit(mEdges[i].mMove) : 0);
+
+            maxLogit = std::max(maxLogit, logits[i]);
+        }
+
+        float sum = 0;
+
+        for (float &logit : logits) {
+            logit = exp(logit - maxLogit);
+            sum += logit;
+        }
+
+        for (u64 i = 0; i < mEdges.size(); i++)
+            mEdges[i].setPrior(logits[i] / sum);
+    }
+
+    // A mating move is moved to the front, since its child may not be expanded
+    inline void findMateInOne(Board &board)
+    {
+        MoveList replies;
+        Board::State state = board.state();
+
+        for (u64 i = 0; i < mEdges.size(); i++)
+        {
+            if (!board.givesCheck(mEdges[i].mMove)) continue;
+
+            board.makeMove(mEdges[i].mMove);
+            board.legalMoves(replies, false);
+            board.restore(state);
+
+            if (replies.size() == 0) {
+                mGameState = GameState::WON;
+                mProvenPlies = 1;
+                std::swap(mEdges[0], mEdges[i]);
+                return;
+            }
+        }
+    }
+
+    // MCTS-Solver
+    // A node is won if a child is lost for the opponent,
+    // lost if every child is won for the opponent,
+    // and drawn if every child is proven and the best of them is a draw
+    // Returns true if the node became proven
+    inline bool updateProvenState()
+    {
+        if (mGameState != GameState::ONGOING) return false;
+
+        bool allProven = true, anyDraw = false;
+        u16 minWinPlies = 0xFFFF, maxLossPlies = 0;
+
+        for (Edge &edge : mEdges)
+        {
+            Node *child = edge.mChild;
+
+            if (child == nullptr || child->mGameState == GameState::ONGOING)
+                allProven = false;
+            else if (child->mGameState == GameState::LOST)
+                minWinPlies = std::min<u16>(minWinPlies, child->mProvenPlies + 1);
+            else if (child->mGameState == GameState::DRAW)
+                anyDraw = true;
+            else
+                maxLossPlies = std::max<u16>(maxLossPlies, child->mProvenPlies + 1);
+        }
+
+        if (minWinPlies != 0xFFFF) {
+            mGameState = GameState::WON;
+            mProvenPlies = minWinPlies;
+            return true;
+        }
+
+        if (!allProven) return false;
+
+        mGameState = anyDraw ? GameState::DRAW : GameState::LOST;
+        mProvenPlies = anyDraw ? 0 : maxLossPlies;
+        return true;
+    }
+
+    // Selection never enters a child that is proven won for the opponent
+    inline static bool isProvenLoss(Edge &edge) {
+        return edge.mChild != nullptr && edge.mChild->mGameState == GameState::WON;
+    }
+
+    inline double Q() {
+        assert(mVisits > 0);
+        return mResultsSum / (double)mVisits;
+    }
+
+    // Exact if the node is terminal or proven
+    inline double minimaxValue() {
+        return mGameState != GameState::ONGOING ? -(double)mGameState : mMinimax;
+    }
+
+    // Best child value for the side to move here, from the perspective of the side that moved into this node
+    // Unvisited children aren't known yet, so a node without visited children keeps its own leaf eval
+    inline void updateMinimax()
+    {
+        double best = -2;
+
+        for (Edge &edge : mEdges)
+            if (edge.mChild != nullptr && edge.mChild->mVisits > 0)
+                best = std::max(best, edge.mChild->minimaxValue());
+
+        if (best > -2) mMinimax = -best;
+    }
+
+    inline void addVirtualLoss() {
+        mVisits++;
+        mResultsSum -= 1;
+    }
+
+    inline void removeVirtualLoss() {
+        mVisits--;
+        mResultsSum += 1;
+    }
+
+    inline double UCT(Edge &edge, const SearchParams &params) {
+        assert(edge.mVisits > 0);
+        assert(mVisits > 0);
+
+        return edge.selectionQ(params) + params.UCT_C() * sqrt(ln(mVisits) / (double)edge.mVisits);
+    }
+
+    // PUCT with first play urgency: unvisited edges are valued at the parent's value minus a reduction,
+    // so a node's best child can be revisited before all its siblings are expanded
+    inline Edge* selectPuct(const SearchParams &params, u32 minVisits)
+    {
+        double fpu = (mVisits > 0 ? -Q() : 0) - params.FPU_REDUCTION();
+        double explorationScale = params.PUCT_C() * sqrt((double)std::max<u32>(mVisits, 1));
+
+        Edge *bestEdge = nullptr;
+        double bestScore = -I32_MAX;
+        u64 numEdges = wideningLimit(params);
+
+        // If every exposed edge is a proven loss, keep widening
+        for (u64 i = 0; i < mEdges.size() && (i < numEdges || bestEdge == nullptr); i++)
+        {
+            Edge &edge = mEdges[i];
+
+            if (isProvenLoss(edge) || edge.mVisits < minVisits) continue;
+
+            double q = edge.mVisits > 0 || edge.mAmafVisits > 0 ? edge.selectionQ(params) : fpu;
+            double score = q + explorationScale * edge.prior() / (1.0 + edge.mVisits);
+
+            if (score > bestScore) {
+                bestScore = score;
+                bestEdge = &edge;
+            }
+        }
+
+        return bestEdge != nullptr ? bestEdge : &mEdges[0];
+    }
+
+    // UCT: expand the exposed children in order first, then pick the child with highest UCT
+    // Edges with less than 'minVisits' visits are skipped (smart pruning at the root)
+    inline Edge* select(const SearchParams &params, u32 minVisits = 0)
+    {
+        assert(mGameState == GameState::ONGOING);
+        assert(mEdges.size() > 0);
+
+        if (params.PUCT() > 0) return selectPuct(params, minVisits);
+
+        if (mNumExpanded < wideningLimit(params) && minVisits == 0)
+            return &mEdges[mNumExpanded++];
+
+        double bestUct = -I32_MAX;
+        int bestEdgeIdx = -1;
+
+        for (u64 i = 0; i < mNumExpanded; i++)
+        {
+            if (isProvenLoss(mEdges[i]) || mEdges[i].mVisits < minVisits) continue;
+
+            // Exposed by a batched path that was dropped
+            if (mEdges[i].mVisits == 0) return &mEdges[i];
+
+            double edgeUct = UCT(mEdges[i], params);
+
+            if (edgeUct > bestUct) {
+                bestUct = edgeUct;
+                bestEdgeIdx = i;
+            }
+        }
+
+        // Every expanded edge is a proven loss
+        if (bestEdgeIdx == -1)
+            return mNumExpanded < mEdges.size() ? &mEdges[mNumExpanded++] : &mEdges[0];
+
+        return &mEdges[bestEdgeIdx];
+    }
+
+    inline static i32 scoreCp(double wdl, double evalScale) {
+        assert(wdl >= -1 && wdl <= 1);
+
+        wdl += 1; // [0, 2]
+        wdl /= 2; // [0, 1]
+
+        constexpr i32 WIN_SCORE = 30'000;
+
+        if (wdl >= 0.99) return WIN_SCORE;
+
+        if (wdl <= 0.01) return -WIN_SCORE;
+
+        // inverse of sigmoid
+        double cpScore = -evalScale * ln((1.0 - wdl) / wdl);
+
+        return std::clamp((i32)round(cpScore), -WIN_SCORE, WIN_SCORE);
+    }
+
+    // Proven nodes play the fastest win or the slowest loss,
+    // otherwise the most visited move that isn't a proven loss
+    inline Edge* bestEdge()
+    {
+        assert(mEdges.size() > 0);
+
+        Edge *best = nullptr;
+
+        if (mGameState == GameState::WON) 
+        {
+            for (Edge &edge : mEdges)
+                if (edge.mChild != nullptr && edge.mChild->mGameState == GameState::LOST
+                && (best == nullptr || edge.mChild->mProvenPlies < best->mChild->mProvenPlies))
+                    best = &edge;
+
+            // Mate in one found when the node was created
+            return best != nullptr ? best : &mEdges[0];
+        }
+
+        for (Edge &edge : mEdges)
+            if (!isProvenLoss(edge) && (best == nullptr || edge.mVisits > best->mVisits))
+                best = &edge;
+
+        if (best != nullptr) return best;
+
+        for (Edge &edge : mEdges)
+            if (best == nullptr || edge.mChild->mProvenPlies > best->mChild->mProvenPlies)
+                best = &edge;
+
+        return best;
+    }
+
+    inline Move bestMove() { return bestEdge()->mMove; }
+
+    // Score of the side to move, from the best edge or the proven result
+    // Centipawns, or if 'isMate', moves to mate (negative if getting mated)
+    inline i32 score(const SearchParams &params, bool &isMate)
+    {
+        isMate = mGameState == GameState::WON || mGameState == GameState::LOST;
+
+        if (mGameState == GameState::WON)
+            return (mProvenPlies + 1) / 2;
+
+        if (mGameState == GameState::LOST)
+            return -(mProvenPlies / 2);
+
+        if (mGameState == GameState::DRAW)
+            return 0;
+
+        return score(*bestEdge(), params, isMate);
+    }
+
+    // Score of the side to move if it plays this edge
+    inline static i32 score(Edge &edge, const SearchParams &params, bool &isMate)
+    {
+        Node *child = edge.mChild;
+        isMate = child != nullptr && (child->mGameState == GameState::LOST || child->mGameState == GameState::WON);
+
+        if (child != nullptr && child->mGameState == GameState::LOST)
+            return (child->mProvenPlies + 2) / 2;
+
+        if (child != nullptr && child->mGameState == GameState::WON)
+            return -((child->mProvenPlies + 1) / 2);
+
+        if (edge.mVisits == 0 || (child != nullptr && child->mGameState == GameState::DRAW))
+            return 0;
+
+        return scoreCp(edge.Q(), params.EVAL_SCALE());
+    }
+
+    inline std::string uciScore(const SearchParams &params) {
+        bool isMate;
+        i32 score = this->score(params, isMate);
+        return (isMate ? "mate " : "cp ") + std::to_string(score);
+    }
+
+    inline static std::string uciScore(Edge &edge, const SearchParams &params) {
+        bool isMate;
+        i32 score = Node::score(edge, params, isMate);
+        return (isMate ? "mate " : "cp ") + std::to_string(score);
+    }
+
+    // Principal variation starting with this edge, following the best edges
+    // 'pv' is cleared, not reallocated
+    inline static void pv(Edge &edge, std::vector<Move> &pv, u64 maxLength = 64)
+    {
+        pv.clear();
+        pv.push_back(edge.mMove);
+
+        Node *node = edge.mChild;
+
+        while (node != nullptr && node->mEdges.size() > 0 && pv.size() < maxLength)
+        {
+            Edge *best = node->bestEdge();
+
+            // Unexplored, except for a mate in one found when the node was created
+            if (best->mVisits == 0 && node->mGameState != GameState::WON) break;
+
+            pv.push_back(best->mMove);
+            node = best->mChild;
+        }
+    }
+
+    // The best edge, then the others by most visits, proven losses last
+    // 'ranked' is cleared, not reallocated
+    inline void rankEdges(std::vector<Edge*> &ranked, u64 count)
+    {
+        ranked.clear();
+
+        Edge *best = bestEdge();
+        ranked.push_back(best);
+
+        for (Edge &edge : mEdges)
+            if (&edge != best) ranked.push_back(&edge);
+
+        count = std::min<u64>(count, ranked.size());
+
+        std::partial_sort(ranked.begin() + 1, ranked.begin() + count, ranked.end(), 
+            [] (Edge *a, Edge *b) {
+                if (isProvenLoss(*a) != isProvenLoss(*b)) return isProvenLoss(*b);
+                return a->mVisits > b->mVisits;
+            });
+
+        ranked.resize(count);
+    }
+
+}; // struct Node
+
+// Average result of this edge
+// In DAG mode, the child may have been visited through other parents,
+// so we prefer its shared statistics over the edge's own
+inline double Edge::Q() {
+    if (mChild != nullptr && mChild->mGameState != GameState::ONGOING)
+        return -(double)mChild->mGameState;
+
+    if (mChild != nullptr && mChild->mVisits > 0)
+        return mChild->Q();
+
+    assert(mVisits > 0);
+    return mResultsSum / (double)mVisits;
+}
+
+// Q blended with the AMAF value, with weight beta = sqrt(k / (3 * visits + k))
+inline double Edge::raveQ(const SearchParams &params)
+{
+    bool exact = mChild != nullptr && mChild->mGameState != GameState::ONGOING;
+
+    if (params.RAVE() == 0 || mAmafVisits == 0 || exact)
+        return Q();
+
+    double amafQ = mAmafResultsSum / (double)mAmafVisits;
+
+    if (mVisits == 0) return amafQ;
+
+    double beta = sqrt((double)params.RAVE_K() / (3.0 * (double)mVisits + (double)params.RAVE_K()));
+    return (1.0 - beta) * Q() + beta * amafQ;
+}
+
+// Implicit minimax backups: the average blended with the child's minimax of heuristic evals,
+// weighted by MINIMAX_WEIGHT, so refutations found deep in the tree count right away
+inline double Edge::selectionQ(const SearchParams &params)
+{
+    double q = raveQ(params);
+
+    if (params.MINIMAX_WEIGHT() <= 0 || mChild == nullptr || mChild->mVisits == 0)
+        return q;
+
+    return (1.0 - params.MINIMAX_WEIGHT()) * q + params.MINIMAX_WEIGHT() * mChild->minimaxValue();
+}
@@ -8,7 +8,7 @@ inline u64 perft(Board board, int depth)
 {
     if (depth <= 0) return 1;
 
-    std::vector<Move> moves;
+    MoveList moves;
     board.legalMoves(moves);
 
     if (depth == 1) return moves.size();
@@ -31,7 +31,7 @@ inline void perftSplit(Board board, int depth)
 
     std::cout << "Running split perft depth " << depth << " on " << board.fen() << std::endl;
 
-    std::vector<Move> moves;
+    MoveList moves;
     board.legalMoves(moves);
 
     if (depth == 1) {
@@ -0,0 +1,60 @@
+// clang-format off
+
+#pragma once
+
+#include "nnue.hpp"
+#include "move.hpp"
+
+// Policy head on top of the value network's hidden layer (side to move perspective)
+// logit(move) = (hidden . fromWeights[from] + hidden . toWeights[piece][to]) / (QA * QB) + toBiases[piece][to] / QB
+// Squares are flipped for black
+
+#if !defined(POLICYFILE)
+    #define POLICYFILE "src/policy.nnue"
+#endif
+
+INCBIN(PolicyFile, POLICYFILE);
+
+namespace policy {
+
+using nnue::HIDDEN_SIZE, nnue::QA, nnue::QB;
+
+struct alignas(64) PolicyNet {
+    MultiArray<i16, 64, HIDDEN_SIZE>    fromWeights; // [from]
+    MultiArray<i16, 6, 64, HIDDEN_SIZE> toWeights;   // [pieceType][to]
+    MultiArray<i16, 6, 64>              toBiases;    // [pieceType][to]
+};
+
+const PolicyNet *POLICY_NET = reinterpret_cast<const PolicyNet*>(gPolicyFileData);
+
+// The hidden layer is computed once per position, then each move costs 2 dot products
+class PolicyHead {
+    private:
+
+    alignas(64) std::array<i16, HIDDEN_SIZE> mHidden;
+    Color mSideToMove;
+
+    public:
+
+    inline PolicyHead(const nnue::Accumulator &accumulator, Color sideToMove) 
+    : mSideToMove(sideToMove)
+    {
+        nnue::clippedHidden(accumulator, sideToMove, mHidden);
+    }
+
+    inline float logit(Move move)
+    {
+        int flip = mSideToMove == Color::BLACK ? 56 : 0;
+        int from = move.from() ^ flip;
+        int to = move.to() ^ flip;
+        int pieceType = (int)(move.promotion() != PieceType::NONE ? move.promotion() : move.pieceType());
+
+        i32 sum = nnue::dot(mHidden, POLICY_NET->fromWeights[from])
+                + nnue::dot(mHidden, POLICY_NET->toWeights[pieceType][to]);
+
+        return (float)sum / (float)(QA * QB) + (float)POLICY_NET->toBiases[pieceType][to] / (float)QB;
+    }
+
+}; // class PolicyHead
+
+} // namespace policy
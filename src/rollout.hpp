@@ -0,0 +1,127 @@
+// clang-format off
+
+#pragma once
+
+#include "evaluator.hpp"
+
+// Playouts from the leaf, played on the leaf board itself and undone at the end
+// Light policy: uniformly random moves
+// Heavy policy: captures are favored and moves are sampled by MAST (the average result of the move in earlier playouts)
+// A playout ends at the end of the game, after ROLLOUT_MAX_PLIES plies (NNUE eval),
+// or as soon as the NNUE eval reaches ROLLOUT_EVAL_CUTOFF
+class RolloutEvaluator : public BatchEvaluator {
+    private:
+
+    constexpr static float MAST_UPDATE_RATE = 1.0 / 32.0;
+
+    // Everything a playout touches, so that playouts don't allocate
+    // A context's playouts all run on its search thread
+    Rng mRng;
+    MoveList mMoves;
+    MoveList mPlayed;
+    std::array<float, 256> mWeights;
+    MultiArray<float, 2, 64, 64> mMast = {}; // [color][from][to], from the mover's perspective
+
+    inline Move pickMove(Board &board)
+    {
+        MoveList &moves = mMoves;
+
+        if (mParams.ROLLOUT_POLICY() == 1)
+            return moves[mRng.next() % moves.size()];
+
+        Color stm = board.sideToMove();
+        double weightsSum = 0;
+
+        for (u64 i = 0; i < moves.size(); i++)
+        {
+            double weight = exp(mMast[(int)stm][moves[i].from()][moves[i].to()] / mParams.MAST_TEMPERATURE());
+
+            if (board.isCapture(moves[i]) || moves[i].promotion() == PieceType::QUEEN)
+                weight *= mParams.ROLLOUT_CAPTURE_WEIGHT();
+
+            mWeights[i] = weight;
+            weightsSum += weight;
+        }
+
+        double pick = mRng.nextDouble() * weightsSum;
+
+        for (u64 i = 0; i < moves.size(); i++)
+        {
+            pick -= mWeights[i];
+            if (pick <= 0) return moves[i];
+        }
+
+        return moves[moves.size() - 1];
+    }
+
+    public:
+
+    using BatchEvaluator::BatchEvaluator;
+
+    // Result in [-1, 1] from the perspective of the side to move
+    // The board is left unchanged
+    inline double rollout(Board &board)
+    {
+        Board::State state = board.state();
+        Color color = board.sideToMove();
+        double wdl; // from the perspective of the side to move at the end of the playout
+        int ply = 0;
+
+        mPlayed.clear();
+
+        while (true)
+        {
+            if (ply > 0 && (board.insufficientMaterial() || board.fiftyMovesDraw() || board.isRepetition())) {
+                wdl = 0;
+                break;
+            }
+
+            board.legalMoves(mMoves, false);
+
+            if (mMoves.size() == 0) {
+                wdl = board.inCheck() ? -1 : 0;
+                break;
+            }
+
+            if (ply >= mParams.ROLLOUT_MAX_PLIES()) {
+                wdl = evalToWdl(board.evaluate());
+                break;
+            }
+
+            if (ply > 0) {
+                i32 eval = board.evaluate();
+
+                if (abs(eval) >= mParams.ROLLOUT_EVAL_CUTOFF()) {
+                    wdl = evalToWdl(eval);
+                    break;
+                }
+            }
+
+            Move move = pickMove(board);
+            mPlayed.push_back(move);
+            board.makeMove(move);
+            ply++;
+        }
+
+        // To the perspective of the side to move at the start
+        if (ply % 2 == 1) wdl = -wdl;
+
+        // MAST: each move's average result for the side that played it
+        for (u64 i = 0; i < mPlayed.size(); i++)
+        {
+            Color mover = i % 2 == 0 ? color : oppColor(color);
+            float &entry = mMast[(int)mover][mPlayed[i].from()][mPlayed[i].to()];
+            entry += MAST_UPDATE_RATE * ((i % 2 == 0 ? wdl : -wdl) - entry);
+        }
+
+        board.restore(state);
+        return wdl;
+    }
+
+    inline void evaluate(std::vector<Board> &boards, u64 count, std::vector<double> &results) override
+    {
+        for (u64 i = 0; i < count; i++)
+            results[i] = rollout(boards[i]);
+    }
+
+}; // class RolloutEvaluator
@@ -2,225 +2,571 @@
 
 #pragma once
 
-#include "board.hpp"
-#include "search_params.hpp"
+#include <typeinfo>
+#include "tree.hpp"
+#include "time_manager.hpp"
+#include "evaluator.hpp"
+#include "eval_cache.hpp"
+#include "rollout.hpp"
+#include "leaf_search.hpp"
+#include "gumbel.hpp"
+
+constexpr u64 DEFAULT_HASH_MB = 512;
+
+// Set by the UCI thread or the time manager's watchdog to end the alpha-beta and mate searches
+// An MCTS search has its own stop flag in its context
+std::atomic<bool> stopSearch = false;
+
+// Only MCTS searches (SearchContext) are reentrant: the alpha-beta and mate searches use process wide state
+// (stopSearch, tt, ab::threadsData, dfpn::mateTable), so only one of them may run at a time
+// A second one, e.g. from another thread, is rejected by this guard instead of destroying the first one's state
+class ProcessSearchGuard {
+    private:
+
+    inline static std::atomic<bool> sRunning = false;
+    bool mAcquired;
 
-struct Node {
     public:
 
-    Node *mParent;
-    std::vector<Node> mChildren = {};
-    std::vector<Move> mMoves = {};
-    GameState mGameState;
-    u32 mVisits = 0;
-    float mResultsSum = 0;
-    u16 mDepth;
-
-    inline Node(Board &board, Node *parent, u16 depth) {
-        mParent = parent;
-        mDepth = depth;
-
-        if (isRoot()) {
-            mGameState = GameState::ONGOING;
-            board.legalMoves(mMoves, false);
-            assert(mMoves.size() > 0);
-        }
-        else if (board.insufficientMaterial() || board.isRepetition()) 
-            mGameState = GameState::DRAW;
-        else {
-            board.legalMoves(mMoves, false);
-
-            mGameState = mMoves.size() == 0
-                         ? (board.inCheck() ? GameState::LOST : GameState::DRAW)
-                         : board.fiftyMovesDraw()
-                         ? GameState::DRAW
-                         : GameState::ONGOING;
-        }
+    inline ProcessSearchGuard() : mAcquired(!sRunning.exchange(true)) { }
 
-        shuffleVector(mMoves);
+    inline ~ProcessSearchGuard() {
+        if (mAcquired) sRunning = false;
+    }
+
+    // false if another alpha-beta or mate search is running, then don't search
+    inline bool acquired() { return mAcquired; }
+
+}; // class ProcessSearchGuard
+
+// Search run by go and bench, set by the Engine UCI option
+enum class Engine { MCTS, ALPHA_BETA };
+Engine engine = Engine::MCTS;
+
+// Limits of a search, besides the clock (TimeManager)
+struct SearchLimits {
+    u64 maxDepth = I64_MAX; // average depth of the iterations
+    u64 maxNodes = I64_MAX;
+    u64 hashMb = DEFAULT_HASH_MB; // tree memory
+    u64 multiPv = 1;
+    std::vector<Move> searchMoves = {}; // if not empty, only those root moves are searched
+};
+
+// A selected path waiting for its leaf to be evaluated
+// mEdges[i] goes from mNodes[i] to mNodes[i+1]
+// The last edge has no node after it when it leads to a repetition in DAG mode or to an unstored leaf
+struct PendingPath {
+    std::vector<Node*> mNodes = {};
+    std::vector<Edge*> mEdges = {};
+    double mWdl = 0;     // leaf value from the perspective of its side to move, if known
+    i32 mEvalIdx = -1;   // index of the leaf in the evaluator's batch, or -1 if 'mWdl' is known
+    bool mExpanded = false;
+};
+
+// Everything an MCTS search reads and writes: parameters, tree, evaluators (with their random generators),
+// eval cache, stop flag and output
+// Contexts share nothing mutable, so independent searches (e.g. many games) can run at the same time
+// on different threads, sharing only the read-only tables (attacks, zobrist keys, networks)
+class SearchContext {
+    private:
+
+    SearchParams mParams;
+    Tree mTree;
+    std::unique_ptr<EvalCache> mOwnEvalCache = nullptr; // null if the cache is shared with other contexts
+    EvalCache *mEvalCache;
+
+    MaterialEvaluator mMaterialEvaluator{mParams};
+    NnueEvaluator mNnueEvaluator{mParams};
+    RolloutEvaluator mRolloutEvaluator{mParams};
+    LeafSearchEvaluator mLeafSearchEvaluator{mParams};
+
+    // Static eval of the leaves, used when playouts and leaf searches are off
+    BatchEvaluator *mLeafEvaluator = &mNnueEvaluator;
+
+    std::atomic<bool> mStop = false;
+    std::ostream *mOutput = &std::cout; // info lines, nullptr = none
+
+    // Eval cache statistics of this context's searches, kept here so that probing a shared cache writes nothing shared
+    u64 mEvalCacheProbes = 0;
+    u64 mEvalCacheHits = 0;
+
+    inline bool probeEvalCache(u64 hash, double &wdl)
+    {
+        mEvalCacheProbes++;
+        bool hit = mEvalCache->probe(hash, wdl);
+        mEvalCacheHits += hit;
+        return hit;
     }
 
-    inline bool isRoot() { return mParent == nullptr; }
+    // Mixed into the eval cache keys, so that the evals of different evaluators or evaluation parameters
+    // (e.g. of sessions sharing a cache) are never taken for each other
+    inline u64 evalCacheKey(BatchEvaluator &evaluator)
+    {
+        u64 key = typeid(evaluator).hash_code();
+        key = (key ^ std::bit_cast<u64>(mParams.EVAL_SCALE())) * 0x9E3779B97F4A7C15ULL;
+        key = (key ^ (u64)mParams.LEAF_SEARCH_DEPTH()) * 0x9E3779B97F4A7C15ULL;
+        return key ^ (key >> 29);
+    }
+
+    // DAG mode: a repetition, or the 50-move rule unless its last move mated
+    inline static bool isPathDraw(Board &board)
+    {
+        if (board.isRepetition()) return true;
+
+        if (!board.fiftyMovesDraw()) return false;
 
-    inline double UCT() {
-        assert(mVisits > 0);
-        assert(!isRoot() && mParent->mVisits > 0);
+        if (!board.inCheck()) return true;
 
-        return mResultsSum / (double)mVisits 
-               + UCT_C() * sqrt(ln(mParent->mVisits) / (double)mVisits);
+        MoveList moves;
+        board.legalMoves(moves, false);
+        return moves.size() > 0;
     }
 
-    inline Node* select(Board &board) 
+    // Reused between info lines so that printing doesn't allocate once their capacity is reached
+    std::vector<Edge*> mRankedEdges = {};
+    std::vector<Move> mPv = {};
+    std::ostringstream mInfo;
+
+    // One line per root move among the 'multiPv' best, all taken from the same tree
+    inline void printInfo(int depth, Node &root, u64 multiPv, u64 nodes, u64 milliseconds, int hashfull) 
     {
-        if (mGameState != GameState::ONGOING
-        || mChildren.size() != mMoves.size())
-            return this;
+        if (mOutput == nullptr) return;
 
-        assert(mMoves.size() > 0 && mChildren.size() > 0);
+        root.rankEdges(mRankedEdges, multiPv);
 
-        double bestUct = mChildren[0].UCT();
-        int bestChildIdx = 0;
+        // Build the whole output first so it isn't interleaved with the UCI thread's output
+        std::ostringstream &info = mInfo;
+        info.str("");
+        info.clear();
 
-        for (u64 i = 1; i < mChildren.size(); i++) 
+        for (u64 i = 0; i < mRankedEdges.size(); i++)
         {
-            double childUct = mChildren[i].UCT();
+            Node::pv(*mRankedEdges[i], mPv);
 
-            if (childUct > bestUct) {
-                bestUct = childUct;
-                bestChildIdx = i;
-            }
+            info << "info depth " << depth;
+
+            if (multiPv > 1)
+                info << " multipv " << i + 1;
+
+            info << " score "    << (i == 0 ? root.uciScore(mParams) : Node::uciScore(*mRankedEdges[i], mParams))
+                 << " nodes "    << nodes
+                 << " nps "      << nodes * 1000 / std::max<u64>(milliseconds, 1)
+                 << " time "     << milliseconds
+                 << " hashfull " << hashfull
+                 << " pv";
+
+            for (Move move : mPv)
+                info << " " << move.toUci();
+
+            info << "\n";
         }
 
-        board.makeMove(mMoves[bestChildIdx]);
-        return mChildren[bestChildIdx].select(board);
-    }
+        // UCI has no field for the visits of a line
+        if (multiPv > 1) 
+        {
+            info << "info string visits";
 
-    inline Node* expand(Board &board) {
-        assert(mGameState == GameState::ONGOING);
-        assert(mMoves.size() > 0);
-        assert(mChildren.size() < mMoves.size());
+            for (Edge *edge : mRankedEdges)
+                info << " " << edge->mMove.toUci() << " " << edge->mVisits;
 
-        Move move = mMoves[mChildren.size()];
-        board.makeMove(move);
+            info << "\n";
+        }
 
-        mChildren.push_back(Node(board, this, mDepth + 1));
-        return &mChildren.back();
+        *mOutput << info.str() << std::flush;
     }
 
-    inline double simulate(Board &board) {
-        if (mGameState != GameState::ONGOING)
-            return (double)mGameState;
+    public:
 
-        constexpr std::array<int, 5> PIECE_VALUES = {100, 300, 315, 500, 900};
-        int eval = int(randomU64() % 7) - 3;
+    inline SearchContext(const SearchParams &params = SearchParams(), u64 evalCacheMb = DEFAULT_EVAL_CACHE_MB)
+    : mParams(params), mOwnEvalCache(std::make_unique<EvalCache>(evalCacheMb)), mEvalCache(mOwnEvalCache.get()) { }
 
-        for (int pieceType = PAWN; pieceType <= QUEEN; pieceType++) 
-        {
-            u64 pieceBb = board.getBitboard((PieceType)pieceType);
+    // The cache is thread safe, so contexts with the same EVAL_SCALE can share one
+    inline SearchContext(const SearchParams &params, EvalCache &sharedEvalCache)
+    : mParams(params), mEvalCache(&sharedEvalCache) { }
 
-            int numPiecesDiff = std::popcount(board.us() & pieceBb) - std::popcount(board.them() & pieceBb);
+    // Not to be changed during a search
+    inline SearchParams& params() { return mParams; }
 
-            eval += PIECE_VALUES[pieceType] * numPiecesDiff;
-        }
+    // Persists across searches, e.g. the moves of a game
+    inline EvalCache& evalCache() { return *mEvalCache; }
 
-        double wdl = 1.0 / (1.0 + exp(-eval / EVAL_SCALE())); // [0, 1]
-        wdl *= 2; // [0, 2]
-        wdl -= 1; // [-1, 1]
+    // Since the context was created
+    inline u64 evalCacheProbes() { return mEvalCacheProbes; }
 
-        assert(wdl >= -1 && wdl <= 1);
-        return wdl;
-    }
+    inline u64 evalCacheHits() { return mEvalCacheHits; }
+
+    inline MaterialEvaluator& materialEvaluator() { return mMaterialEvaluator; }
+
+    inline RolloutEvaluator& rolloutEvaluator() { return mRolloutEvaluator; }
+
+    inline void setLeafEvaluator(BatchEvaluator *evaluator) { mLeafEvaluator = evaluator; }
+
+    inline void setOutput(std::ostream *output) { mOutput = output; }
+
+    // Root of the last search, valid until the next search or releaseTree()
+    inline Node& root() { return *mTree.root(); }
+
+    // Memory of the last search's tree, at most its Hash after garbage collection
+    inline u64 treeBytes() { return mTree.bytesUsed(); }
+
+    // The tree is kept after a search, until the next one resets it
+    // Releasing it frees its memory while the context is idle
+    inline void releaseTree() { mTree.release(); }
+
+    // Thread safe, ends the search in progress (or the next one, if called before it starts)
+    inline void stop() { mStop = true; }
+
+    inline void clearStop() { mStop = false; }
+
+    // Returns best move, ponder move (MOVE_NONE if unknown) and nodes
+    // The stop flag isn't cleared, see clearStop()
+    inline std::tuple<Move, Move, u64> search(const Board &rootBoard, TimeManager &timeManager, const SearchLimits &limits)
+    {
+        std::chrono::time_point<std::chrono::steady_clock> startTime = std::chrono::steady_clock::now();
+
+        const u64 maxDepth = limits.maxDepth, maxNodes = limits.maxNodes, multiPv = limits.multiPv;
 
-    inline void backprop(double wdl) {
-        assert(!isRoot());
-        assert(wdl >= -1 && wdl <= 1);
+        mMaterialEvaluator.mRng = Rng();
 
-        Node *current = this;
-        while (current != nullptr) 
+        Board board = rootBoard;
+        Color rootColor = board.sideToMove();
+        mTree.reset(board, mParams, limits.hashMb * 1024 * 1024);
+        Node *root = mTree.root();
+        u64 nodes = 0;
+
+        if (limits.searchMoves.size() > 0)
+            root->restrictMoves(board, limits.searchMoves, mParams);
+
+        u64 depthSum = 0;
+        int lastPrintedDepth = 0;
+
+        // Gumbel root: needs a node budget, and the other lines aren't searched (MultiPV)
+        bool useGumbel = mParams.GUMBEL() > 0 && maxNodes != (u64)I64_MAX && multiPv == 1 && root->mEdges.size() > 1;
+        SequentialHalving sequentialHalving;
+
+        if (useGumbel) sequentialHalving.init(*root, board, maxNodes, mParams);
+
+        // Smart pruning: root edges with less visits can't become the most visited anymore
+        u32 rootMinVisits = 0;
+        bool stoppedBySmartPruning = false;
+
+        // Only one legal move, no need to search it when playing on the clock
+        // (with movetime or a node limit, e.g. analysis, the position still gets its evaluation)
+        if (root->mEdges.size() == 1 && timeManager.isClockManaged() && !timeManager.isPondering())
         {
-            current->mVisits++;
-            wdl *= -1;
-            current->mResultsSum += wdl;
-            current = current->mParent;
+            printInfo(0, *root, multiPv, 0, millisecondsElapsed(startTime), mTree.hashfull());
+
+            return {root->bestMove(), MOVE_NONE, 0};
         }
-    }
 
-    inline i16 scoreCp() {
-        assert(mVisits > 0);
+        timeManager.startWatchdog(mStop);
+
+        const u64 batchSize = std::max<i32>(mParams.BATCH_SIZE(), 1);
 
-        double wdl = mResultsSum / (double)mVisits; // [-1, 1]
-        assert(wdl >= -1 && wdl <= 1);
+        // Paths of the current batch, reused between batches
+        std::vector<PendingPath> batch(batchSize);
 
-        wdl += 1; // [0, 2]
-        wdl /= 2; // [0, 1]
+        for (PendingPath &path : batch) {
+            path.mNodes.reserve(256);
+            path.mEdges.reserve(256);
+        }
 
-        constexpr i32 WIN_SCORE = 30'000;
+        // Leaves of the batch that need the evaluator
+        std::vector<Board> evalBoards(batchSize, rootBoard);
+        std::vector<double> evalResults(batchSize, 0);
 
-        if (wdl >= 0.99) return WIN_SCORE;
+        // Playout results are random, so they aren't cached
+        BatchEvaluator *evaluator = mParams.ROLLOUT_POLICY() > 0 ? &mRolloutEvaluator 
+                                  : mParams.LEAF_SEARCH() > 0    ? &mLeafSearchEvaluator 
+                                  : mLeafEvaluator;
+        bool useEvalCache = mParams.ROLLOUT_POLICY() == 0;
+        const u64 cacheKey = evalCacheKey(*evaluator);
 
-        if (wdl <= 0.01) return -WIN_SCORE;
+        // RAVE: [parity of the ply][from * 64 + to] = last iteration in which that side played the move
+        std::vector<u32> amafStamps(mParams.RAVE() > 0 ? 2 * 64 * 64 : 0, 0);
 
-        // inverse of sigmoid
-        double cpScore = -EVAL_SCALE() * ln((1.0 - wdl) / wdl); 
+        // MCTS loop, one batch of iterations at a time, until the limits are hit or the root is proven
+        while (root->mGameState == GameState::ONGOING)
+        {
+            u64 batchCount = 0;
+            u64 numEvals = 0;
 
-        return std::clamp((i32)round(cpScore), -WIN_SCORE, WIN_SCORE);
-    }
+            // Select up to 'batchSize' paths, stopping early if a path runs into a leaf of the batch
+            while (batchCount < batchSize && nodes + batchCount < maxNodes)
+            {
+                PendingPath &path = batch[batchCount];
+                path.mNodes.clear();
+                path.mEdges.clear();
+                path.mNodes.push_back(root);
+                path.mWdl = 0;
+                path.mEvalIdx = -1;
+                path.mExpanded = false;
+
+                Node *node = root;
+                bool isTransposition = false;
+                bool collision = false;
+
+                // Selection and expansion
+                while (node->mGameState == GameState::ONGOING)
+                {
+                    Edge *edge = node != root ? node->select(mParams)
+                               : useGumbel    ? sequentialHalving.select(*root)
+                               : node->select(mParams, rootMinVisits);
+                    board.makeMove(edge->mMove);
+                    path.mEdges.push_back(edge);
+
+                    // Repetitions and 50-move draws depend on the path, not on the node
+                    if (mTree.dagMode() && isPathDraw(board)) {
+                        node = nullptr;
+                        break;
+                    }
+
+                    path.mExpanded = edge->mChild == nullptr;
+
+                    // Out of memory: evaluate the position without storing it
+                    if (path.mExpanded && !mTree.canExpand()) 
+                    {
+                        Node leaf = Node(board, false, !mTree.dagMode(), mTree.history(), mParams);
+
+                        if (leaf.mGameState != GameState::ONGOING)
+                            path.mWdl = (double)leaf.mGameState;
+                        else if (useEvalCache && probeEvalCache(board.zobristHash() ^ cacheKey, path.mWdl))
+                            ; // evaluated before
+                        else {
+                            evalBoards[numEvals] = board;
+                            path.mEvalIdx = numEvals++;
+                        }
+
+                        node = nullptr;
+                        path.mExpanded = false;
+                        break;
+                    }
+
+                    if (path.mExpanded)
+                        edge->mChild = mTree.expand(board, isTransposition);
+
+                    node = edge->mChild;
+
+                    if (node->mPendingEval) {
+                        collision = true;
+                        break;
+                    }
+
+                    path.mNodes.push_back(node);
+
+                    if (path.mExpanded) break;
+                }
+
+                if (collision) {
+                    board <<= rootBoard;
+                    break;
+                }
+
+                // Leaf value, or a slot in the evaluator's batch
+                if (node == nullptr)
+                    ; // repetition draw or unstored leaf
+                else if (node->mGameState != GameState::ONGOING)
+                    path.mWdl = (double)node->mGameState;
+                else if (isTransposition && node->mVisits > 0)
+                    path.mWdl = -node->Q();
+                else if (useEvalCache && probeEvalCache(board.zobristHash() ^ cacheKey, path.mWdl))
+                    ; // evaluated before
+                else {
+                    node->mPendingEval = true;
+                    evalBoards[numEvals] = board;
+                    path.mEvalIdx = numEvals++;
+                }
+
+                if (batchSize > 1) {
+                    for (Node *pathNode : path.mNodes) pathNode->addVirtualLoss();
+                    for (Edge *pathEdge : path.mEdges) pathEdge->addVirtualLoss();
+                }
+
+                batchCount++;
+                board <<= rootBoard; // fast copy (board = rootBoard)
+            }
 
-    inline Move mostVisitsMove() 
-    {
-        assert(mMoves.size() > 0 && mChildren.size() > 0);
+            // Simulation
+            if (numEvals > 0)
+                evaluator->evaluate(evalBoards, numEvals, evalResults);
 
-        u32 mostVisits = mChildren[0].mVisits;
-        Move bestMove = mMoves[0];
+            for (u64 i = 0; useEvalCache && i < numEvals; i++)
+                mEvalCache->store(evalBoards[i].zobristHash() ^ cacheKey, evalResults[i]);
 
-        for (u64 i = 1; i < mChildren.size(); i++)
-            if (mChildren[i].mVisits > mostVisits)
+            // Backpropagation
+            for (u64 b = 0; b < batchCount; b++)
             {
-                mostVisits = mChildren[i].mVisits;
-                bestMove = mMoves[i];
+                std::vector<Node*> &nodesPath = batch[b].mNodes;
+                std::vector<Edge*> &edgesPath = batch[b].mEdges;
+
+                if (batchSize > 1) {
+                    for (Node *pathNode : nodesPath) pathNode->removeVirtualLoss();
+                    for (Edge *pathEdge : edgesPath) pathEdge->removeVirtualLoss();
+                }
+
+                // Leaf node, or null if the last edge has no node after it
+                Node *node = nodesPath.size() > edgesPath.size() ? nodesPath.back() : nullptr;
+
+                // From the perspective of the side to move in the leaf
+                double wdl = batch[b].mEvalIdx >= 0 ? evalResults[batch[b].mEvalIdx] : batch[b].mWdl;
+
+                if (node != nullptr) node->mPendingEval = false;
+
+                assert(wdl >= -1 && wdl <= 1);
+
+                // Implicit minimax: a new leaf starts at its eval
+                if (mParams.MINIMAX_WEIGHT() > 0 && node != nullptr && node->mVisits == 0)
+                    node->mMinimax = -wdl;
+
+                // Color that played the last edge
+                Color color = edgesPath.size() % 2 == 1 ? rootColor : oppColor(rootColor);
+
+                for (int i = edgesPath.size(); i >= 0; i--)
+                {
+                    if (i < (int)nodesPath.size()) {
+                        nodesPath[i]->mVisits++;
+                        nodesPath[i]->mResultsSum -= wdl;
+                    }
+
+                    if (i > 0) {
+                        edgesPath[i - 1]->mVisits++;
+                        edgesPath[i - 1]->mResultsSum -= wdl;
+                        mTree.history().update(color, edgesPath[i - 1]->mMove, -wdl);
+                        color = oppColor(color);
+                    }
+
+                    // Every edge of the parent whose move its side played from here to the leaf
+                    if (i > 0 && mParams.RAVE() > 0)
+                    {
+                        u32 *stamps = &amafStamps[(i - 1) % 2 * 64 * 64];
+                        u32 iteration = nodes + 1;
+                        Move move = edgesPath[i - 1]->mMove;
+
+                        stamps[move.from() * 64 + move.to()] = iteration;
+
+                        for (Edge &edge : nodesPath[i - 1]->mEdges)
+                            if (stamps[edge.mMove.from() * 64 + edge.mMove.to()] == iteration) {
+                                edge.mAmafVisits++;
+                                edge.mAmafResultsSum -= wdl;
+                            }
+                    }
+
+                    wdl *= -1;
+                }
+
+                // Then its ancestors take their best child's value
+                if (mParams.MINIMAX_WEIGHT() > 0)
+                    for (int i = (int)edgesPath.size() - 1; i >= 0; i--)
+                        nodesPath[i]->updateMinimax();
+
+                // A leaf may be terminal or proven, then its ancestors may become proven too
+                // Not only new leaves: in DAG mode, a node proven through one parent is reached later through others
+                if (mParams.MCTS_SOLVER() > 0 && node != nullptr && node->mGameState != GameState::ONGOING)
+                    for (int i = (int)nodesPath.size() - 2; i >= 0; i--)
+                        if (!nodesPath[i]->updateProvenState()) break;
+
+                nodes++;
+                depthSum += (u64)edgesPath.size();
             }
 
-        return bestMove;
-    }
+            // Limits are checked every 64 iterations
+            bool checkLimits = nodes / 64 != (nodes - batchCount) / 64;
 
-}; // struct Node
+            mTree.collectGarbage();
 
-inline void printInfo(int depth, i32 scoreCp, u64 nodes, u64 milliseconds, Move bestMove) 
-{
-    std::cout << "info"
-              << " depth "    << depth
-              << " score cp " << scoreCp
-              << " nodes "    << nodes
-              << " nps "      << nodes * 1000 / std::max<u64>(milliseconds, 1)
-              << " time "     << milliseconds
-              << " pv "       << bestMove.toUci()
-              << std::endl;
-}
+            double depthAvg = (double)depthSum / (double)std::max<u64>(nodes, 1);
 
-inline std::tuple<Move, u64> search(const Board &rootBoard, u64 searchTimeMs, u64 maxDepth, u64 maxNodes, bool boolPrintInfo)
-{
-    std::chrono::time_point<std::chrono::steady_clock> startTime = std::chrono::steady_clock::now();
+            if (depthAvg >= maxDepth) break;
 
-    resetRng();
+            int depthAvgRounded = round(depthAvg);
 
-    Board board = rootBoard;
-    Node root = Node(board, nullptr, 0);
-    u64 nodes = 0;
+            if (depthAvgRounded != lastPrintedDepth) {
+                printInfo(depthAvgRounded, *root, multiPv, nodes, millisecondsElapsed(startTime), mTree.hashfull());
+                lastPrintedDepth = depthAvgRounded;
+            }
 
-    u64 depthSum = 0;
-    int lastPrintedDepth = 0;
+            if (mStop.load(std::memory_order_relaxed) || nodes >= maxNodes) 
+                break;
 
-    // MCTS iteration loop
-    do {
-        Node* node = root.select(board);
+            if (checkLimits && timeManager.isLimited())
+            {
+                Edge *bestEdge = root->bestEdge();
+                double bestShare = (double)bestEdge->mVisits / (double)std::max<u32>(root->mVisits, 1);
 
-        if (node->mGameState == GameState::ONGOING)
-            node = node->expand(board);
+                if (timeManager.softLimitReached(bestEdge->mMove, bestShare))
+                    break;
+            }
+
+            // With MultiPV, the other lines must keep being searched, and the Gumbel root schedules its own visits
+            if (checkLimits && mParams.SMART_PRUNING() > 0 && multiPv == 1 && !useGumbel
+            && (timeManager.isLimited() || maxNodes != (u64)I64_MAX))
+            {
+                u64 remaining = maxNodes - nodes;
+                u64 elapsed = timeManager.elapsedMs();
+
+                if (timeManager.isLimited() && !timeManager.isPondering())
+                {
+                    u64 limitMs = elapsed < timeManager.softLimitMs() ? timeManager.softLimitMs() : timeManager.hardLimitMs();
+                    u64 remainingMs = limitMs > elapsed ? limitMs - elapsed : 0;
+
+                    // Project the remaining iterations at the current nps
+                    u64 searchMs = std::max<u64>(millisecondsElapsed(startTime), 1);
+                    remaining = std::min<u64>(remaining, (u128)nodes * remainingMs / searchMs);
+                }
 
-        double wdl = node->simulate(board);
-        node->backprop(wdl);
+                remaining = (double)remaining * mParams.SMART_PRUNING_FACTOR();
 
-        nodes++;
-        board <<= rootBoard; // fast copy (board = rootBoard)
+                u32 bestVisits = 0, secondVisits = 0;
 
-        depthSum += (u64)node->mDepth;
-        double depthAvg = (double)depthSum / (double)nodes;
+                for (Edge &edge : root->mEdges)
+                {
+                    if (Node::isProvenLoss(edge)) continue;
 
-        if (depthAvg >= maxDepth) break;
+                    if (edge.mVisits > bestVisits) {
+                        secondVisits = bestVisits;
+                        bestVisits = edge.mVisits;
+                    }
+                    else if (edge.mVisits > secondVisits)
+                        secondVisits = edge.mVisits;
+                }
 
-        int depthAvgRounded = round(depthAvg);
+                if (bestVisits > secondVisits + remaining && !timeManager.isPondering()) {
+                    stoppedBySmartPruning = true;
+                    break;
+                }
 
-        if (boolPrintInfo && depthAvgRounded != lastPrintedDepth) {
-            printInfo(depthAvgRounded, root.scoreCp(), nodes, millisecondsElapsed(startTime), root.mostVisitsMove());
-            lastPrintedDepth = depthAvgRounded;
+                rootMinVisits = bestVisits > remaining ? bestVisits - remaining : 0;
+            }
         }
-    }
-    while (nodes < maxNodes && (nodes % 512 != 0 || millisecondsElapsed(startTime) < searchTimeMs));
 
-    if (boolPrintInfo) {
-        int depthAvg = round((double)depthSum / (double)nodes);
-        printInfo(depthAvg, root.scoreCp(), nodes, millisecondsElapsed(startTime), root.mostVisitsMove());
+        timeManager.stopWatchdog();
+
+        if (stoppedBySmartPruning)
+        {
+            u64 elapsed = timeManager.elapsedMs();
+            u64 savedMs = timeManager.isLimited() && timeManager.softLimitMs() > elapsed
+                          ? timeManager.softLimitMs() - elapsed : 0;
+
+            timeManager.addSavedTime(savedMs);
+
+            if (mOutput != nullptr)
+                *mOutput << "info string smart pruning stopped the search early, saved "
+                          << (timeManager.isLimited() ? std::to_string(savedMs) + " ms" : std::to_string(maxNodes - nodes) + " nodes")
+                          << std::endl;
+        }
+
+        int depthAvg = round((double)depthSum / (double)std::max<u64>(nodes, 1));
+        printInfo(depthAvg, *root, multiPv, nodes, millisecondsElapsed(startTime), mTree.hashfull());
+
+        Edge *bestEdge = root->bestEdge();
+        Node *bestChild = bestEdge->mChild;
+
+        Move ponderMove = bestChild != nullptr && bestChild->mGameState == GameState::ONGOING && bestChild->mVisits > 1
+                          ? bestChild->bestMove() 
+                          : MOVE_NONE;
+
+        return {bestEdge->mMove, ponderMove, nodes};
     }
 
-    return {root.mostVisitsMove(), nodes};
-}
+
+}; // class SearchContext
@@ -24,10 +24,116 @@ using TunableParamVariant = std::variant<
     TunableParam<float>*
 >;
 
-TunableParam<double> UCT_C = TunableParam<double>(1.5, 1.1, 4.0, 0.1);
-TunableParam<double> EVAL_SCALE = TunableParam<double>(200, 100, 800, 50);
+// The tunable parameters of a search
+// Each search context has its own copy, so searches with different parameters can run at the same time
+struct SearchParams {
+    public:
 
-tsl::ordered_map<std::string, TunableParamVariant> tunableParams = {
-    {stringify(UCT_C), &UCT_C},
-    {stringify(EVAL_SCALE), &EVAL_SCALE}
-};
+    TunableParam<double> UCT_C = TunableParam<double>(1.5, 1.1, 4.0, 0.1);
+    TunableParam<double> EVAL_SCALE = TunableParam<double>(200, 100, 800, 50);
+
+    // 1 = transpositions share a node (the tree becomes a DAG)
+    TunableParam<i32> DAG_MODE = TunableParam<i32>(0, 0, 1, 1);
+
+    // 1 = propagate proven wins, losses and draws through the tree
+    TunableParam<i32> MCTS_SOLVER = TunableParam<i32>(1, 0, 1, 1);
+
+    // 1 = stop early, and stop visiting root moves, when the remaining iterations
+    // (projected at the current nps, times SMART_PRUNING_FACTOR) can't change the most visited root move
+    TunableParam<i32> SMART_PRUNING = TunableParam<i32>(1, 0, 1, 1);
+    TunableParam<double> SMART_PRUNING_FACTOR = TunableParam<double>(1.0, 0.5, 2.0, 0.1);
+
+    // 1 = PUCT selection with first play urgency instead of UCT
+    TunableParam<i32> PUCT = TunableParam<i32>(0, 0, 1, 1);
+    TunableParam<double> PUCT_C = TunableParam<double>(2.0, 0.5, 5.0, 0.1);
+    TunableParam<double> FPU_REDUCTION = TunableParam<double>(0.3, 0.0, 1.0, 0.05);
+
+    // 1 = only the ceil(PW_C * (visits + 1) ^ PW_EXPONENT) best ordered moves of a node are searched
+    TunableParam<i32> PROGRESSIVE_WIDENING = TunableParam<i32>(1, 0, 1, 1);
+    TunableParam<double> PW_C = TunableParam<double>(2.0, 1.0, 8.0, 0.5);
+    TunableParam<double> PW_EXPONENT = TunableParam<double>(0.5, 0.2, 0.8, 0.05);
+
+    // 1 = PUCT priors from captures, promotions and checks, 0 = uniform priors
+    TunableParam<i32> HEURISTIC_PRIORS = TunableParam<i32>(1, 0, 1, 1);
+
+    // 1 = the policy network's logits are added to the PUCT prior logits
+    TunableParam<i32> POLICY_NET = TunableParam<i32>(1, 0, 1, 1);
+
+    // 1 = RAVE (all moves as first) values are blended into the edges' values
+    // RAVE_K is the number of visits at which both values weigh the same
+    TunableParam<i32> RAVE = TunableParam<i32>(0, 0, 1, 1);
+    TunableParam<i32> RAVE_K = TunableParam<i32>(250, 10, 5000, 50);
+
+    // Leaves selected (with virtual loss) before being evaluated together, 1 = no batching
+    TunableParam<i32> BATCH_SIZE = TunableParam<i32>(1, 1, 256, 4);
+
+    // Leaf evaluation by playouts instead of the static eval: 0 = off, 1 = light (random), 2 = heavy (captures, MAST)
+    TunableParam<i32> ROLLOUT_POLICY = TunableParam<i32>(0, 0, 2, 1);
+    TunableParam<i32> ROLLOUT_MAX_PLIES = TunableParam<i32>(16, 0, 200, 4);
+    TunableParam<i32> ROLLOUT_EVAL_CUTOFF = TunableParam<i32>(500, 100, 2000, 50);
+    TunableParam<double> ROLLOUT_CAPTURE_WEIGHT = TunableParam<double>(4.0, 1.0, 16.0, 0.5);
+    TunableParam<double> MAST_TEMPERATURE = TunableParam<double>(0.5, 0.1, 2.0, 0.1);
+
+    // 1 = leaves are evaluated by an alpha-beta search of LEAF_SEARCH_DEPTH plies (0 = quiescence only)
+    TunableParam<i32> LEAF_SEARCH = TunableParam<i32>(0, 0, 1, 1);
+    TunableParam<i32> LEAF_SEARCH_DEPTH = TunableParam<i32>(0, 0, 3, 1);
+
+    // Weight of the implicit minimax value (of the leaf evals) blended with the average result in selection, 0 = off
+    TunableParam<double> MINIMAX_WEIGHT = TunableParam<double>(0.0, 0.0, 1.0, 0.05);
+
+    // 1 = with a node budget (go nodes), the root samples GUMBEL_M moves by Gumbel-top-k over the priors
+    // and splits the budget between them by sequential halving
+    TunableParam<i32> GUMBEL = TunableParam<i32>(0, 0, 1, 1);
+    TunableParam<i32> GUMBEL_M = TunableParam<i32>(16, 2, 64, 2);
+    TunableParam<double> GUMBEL_C_VISIT = TunableParam<double>(50, 0, 200, 10);
+    TunableParam<double> GUMBEL_C_SCALE = TunableParam<double>(1.0, 0.1, 5.0, 0.1);
+
+    // Alpha-beta engine (Engine AlphaBeta)
+    TunableParam<i32> ASPIRATION_DELTA = TunableParam<i32>(25, 5, 100, 5);
+    TunableParam<i32> NMP_BASE_REDUCTION = TunableParam<i32>(3, 1, 5, 1);
+    TunableParam<i32> NMP_DEPTH_DIVISOR = TunableParam<i32>(4, 2, 8, 1);
+    TunableParam<double> LMR_BASE = TunableParam<double>(0.75, 0.0, 1.5, 0.1);
+    TunableParam<double> LMR_DIVISOR = TunableParam<double>(2.25, 1.5, 4.0, 0.25);
+
+    // By UCI option name, to set them
+    inline tsl::ordered_map<std::string, TunableParamVariant> tunableParams()
+    {
+        return {
+            {stringify(UCT_C), &UCT_C},
+            {stringify(EVAL_SCALE), &EVAL_SCALE},
+            {stringify(DAG_MODE), &DAG_MODE},
+            {stringify(MCTS_SOLVER), &MCTS_SOLVER},
+            {stringify(SMART_PRUNING), &SMART_PRUNING},
+            {stringify(SMART_PRUNING_FACTOR), &SMART_PRUNING_FACTOR},
+            {stringify(PUCT), &PUCT},
+            {stringify(PUCT_C), &PUCT_C},
+            {stringify(FPU_REDUCTION), &FPU_REDUCTION},
+            {stringify(PROGRESSIVE_WIDENING), &PROGRESSIVE_WIDENING},
+            {stringify(PW_C), &PW_C},
+            {stringify(PW_EXPONENT), &PW_EXPONENT},
+            {stringify(HEURISTIC_PRIORS), &HEURISTIC_PRIORS},
+            {stringify(POLICY_NET), &POLICY_NET},
+            {stringify(RAVE), &RAVE},
+            {stringify(RAVE_K), &RAVE_K},
+            {stringify(BATCH_SIZE), &BATCH_SIZE},
+            {stringify(ROLLOUT_POLICY), &ROLLOUT_POLICY},
+            {stringify(ROLLOUT_MAX_PLIES), &ROLLOUT_MAX_PLIES},
+            {stringify(ROLLOUT_EVAL_CUTOFF), &ROLLOUT_EVAL_CUTOFF},
+            {stringify(ROLLOUT_CAPTURE_WEIGHT), &ROLLOUT_CAPTURE_WEIGHT},
+            {stringify(MAST_TEMPERATURE), &MAST_TEMPERATURE},
+            {stringify(LEAF_SEARCH), &LEAF_SEARCH},
+            {stringify(LEAF_SEARCH_DEPTH), &LEAF_SEARCH_DEPTH},
+            {stringify(MINIMAX_WEIGHT), &MINIMAX_WEIGHT},
+            {stringify(GUMBEL), &GUMBEL},
+            {stringify(GUMBEL_M), &GUMBEL_M},
+            {stringify(GUMBEL_C_VISIT), &GUMBEL_C_VISIT},
+            {stringify(GUMBEL_C_SCALE), &GUMBEL_C_SCALE},
+            {stringify(ASPIRATION_DELTA), &ASPIRATION_DELTA},
+            {stringify(NMP_BASE_REDUCTION), &NMP_BASE_REDUCTION},
+            {stringify(NMP_DEPTH_DIVISOR), &NMP_DEPTH_DIVISOR},
+            {stringify(LMR_BASE), &LMR_BASE},
+            {stringify(LMR_DIVISOR), &LMR_DIVISOR}
+        };
+    }
+
+}; // struct SearchParams
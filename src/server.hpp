@@ -0,0 +1,554 @@
+// clang-format off
+
+#pragma once
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include "uci.hpp"
+
+namespace server { // Many UCI sessions in one engine process, over a Unix domain socket
+
+// Every connection is a UCI session with its own board, tree, clock and options
+// The sessions share the networks, the attack tables, one eval cache and a pool of workers that runs their searches
+// The cache keys include the evaluator configuration, so sessions with different evaluation options can share it
+// The pool runs the searches in the order of their go commands, and a session has at most one search queued or running,
+// so a busy session can't starve the others; stopping a search that is still queued cancels it without waiting for the pool
+// Searches without an end of their own (go infinite, go ponder) would hold a worker until stop or ponderhit,
+// so they run on a thread of their own instead, and the pool only runs searches bounded by a clock or a limit
+// Only the MCTS engine is served (the alpha-beta and mate searches have process wide tables)
+// Commands come from untrusted clients: FENs and moves are validated before they reach a board
+
+constexpr u64 DEFAULT_SESSION_HASH_MB = 64;
+constexpr u64 DEFAULT_SHARED_EVAL_CACHE_MB = 256;
+constexpr u64 MAX_ACCEPT_BACKOFF_MS = 1000;
+
+// Searches of the sessions, run by a fixed number of threads in FIFO order
+class WorkerPool {
+    private:
+
+    std::vector<std::thread> mWorkers = {};
+    std::deque<std::function<void()>> mJobs = {};
+    std::mutex mMutex;
+    std::condition_variable mCv;
+    bool mExit = false;
+
+    inline void workerLoop()
+    {
+        while (true)
+        {
+            std::function<void()> job;
+
+            {
+                std::unique_lock<std::mutex> lock(mMutex);
+                mCv.wait(lock, [&] { return mExit || mJobs.size() > 0; });
+
+                if (mExit) return;
+
+                job = std::move(mJobs.front());
+                mJobs.pop_front();
+            }
+
+            job();
+        }
+    }
+
+    public:
+
+    inline WorkerPool(u64 numWorkers)
+    {
+        for (u64 i = 0; i < std::max<u64>(numWorkers, 1); i++)
+            mWorkers.emplace_back([this] () { workerLoop(); });
+    }
+
+    inline ~WorkerPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mExit = true;
+        }
+
+        mCv.notify_all();
+
+        for (std::thread &worker : mWorkers)
+            worker.join();
+    }
+
+    inline void submit(std::function<void()> job)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mJobs.push_back(std::move(job));
+        }
+
+        mCv.notify_one();
+    }
+
+}; // class WorkerPool
+
+class Session;
+
+// Stream of a session's search output (info lines), sent to its socket on every flush
+class SessionOutputBuf : public std::stringbuf {
+    private:
+
+    Session &mSession;
+
+    protected:
+
+    inline int sync() override;
+
+    public:
+
+    inline SessionOutputBuf(Session &session) : mSession(session) { }
+
+}; // class SessionOutputBuf
+
+class Session : public std::enable_shared_from_this<Session> {
+    private:
+
+    int mFd;
+    WorkerPool &mPool;
+
+    Board mBoard = Board(START_FEN);
+    SearchContext mContext;
+    TimeManager mTimeManager;
+
+    u64 mHashMb = DEFAULT_SESSION_HASH_MB;
+    u64 mMoveOverheadMs = DEFAULT_MOVE_OVERHEAD_MS;
+    u64 mMultiPv = 1;
+
+    // Budget of every search of the session, 0 = none
+    u64 mMaxNodes = 0;
+    u64 mMaxMoveTimeMs = 0;
+
+    SessionOutputBuf mOutputBuf = SessionOutputBuf(*this);
+    std::ostream mOutput = std::ostream(&mOutputBuf);
+    std::mutex mSendMutex;
+
+    // The session is busy from go until its bestmove is sent
+    // In go infinite and go ponder, a finished search leaves its bestmove for stop or ponderhit,
+    // so waiting for them doesn't hold a worker
+    std::mutex mSearchMutex;
+    std::condition_variable mSearchCv;
+    bool mBusy = false;
+    bool mStarted = false;
+    bool mStopRequested = false;
+    u64 mSearchId = 0; // a queued search whose id is no longer current was cancelled
+    uci::GoCommand mGo;
+    std::chrono::steady_clock::time_point mQueuedTime;
+    std::string mHeldBestmove = "";
+
+    // Expects the search mutex to be locked
+    inline void finishSearch(const std::string &bestmove)
+    {
+        send(bestmove);
+        mHeldBestmove = "";
+        mBusy = false;
+        mSearchCv.notify_all();
+    }
+
+    inline static std::string bestmoveLine(Move bestMove, Move ponderMove)
+    {
+        return "bestmove " + bestMove.toUci() + (ponderMove != MOVE_NONE ? " ponder " + ponderMove.toUci() : "");
+    }
+
+    // Run by a worker
+    inline void runSearch(u64 searchId)
+    {
+        uci::GoCommand go;
+
+        // Locked so that a ponderhit is either applied to the command or to the started clock
+        {
+            std::lock_guard<std::mutex> lock(mSearchMutex);
+
+            if (searchId != mSearchId) return; // cancelled while queued
+
+            mStarted = true;
+            go = mGo;
+
+            // The game clock ran while the search was queued
+            i64 waitedMs = millisecondsElapsed(mQueuedTime);
+
+            if (go.milliseconds != I64_MAX)
+                go.milliseconds = std::max<i64>(go.milliseconds - waitedMs, 1);
+
+            if (go.moveTimeMs != I64_MAX)
+                go.moveTimeMs = std::max<i64>(go.moveTimeMs - waitedMs, 1);
+
+            mTimeManager.init(go.milliseconds, go.incrementMs, go.movesToGo, go.moveTimeMs, mMoveOverheadMs, go.isPonder);
+
+            // A ceiling on the clock's limits, which still apply if lower; go infinite stays infinite
+            if (mMaxMoveTimeMs > 0 && !go.isInfinite)
+                mTimeManager.capTime(mMaxMoveTimeMs);
+        }
+
+        SearchLimits limits = { go.maxDepth, go.maxNodes, mHashMb, mMultiPv, go.searchMoves };
+        auto [bestMove, ponderMove, nodes] = mContext.search(mBoard, mTimeManager, limits);
+
+        mContext.releaseTree();
+
+        std::string bestmove = bestmoveLine(bestMove, ponderMove);
+
+        std::lock_guard<std::mutex> lock(mSearchMutex);
+
+        if ((go.isInfinite || mTimeManager.isPondering()) && !mStopRequested)
+            mHeldBestmove = bestmove;
+        else
+            finishSearch(bestmove);
+    }
+
+    inline void stopAndWait()
+    {
+        std::unique_lock<std::mutex> lock(mSearchMutex);
+
+        if (!mBusy) return;
+
+        // Still queued: cancel it in place rather than wait for a worker to reach it,
+        // and answer from a one-node search (priors only), the context being unused until then
+        if (!mStarted)
+        {
+            mSearchId++;
+            uci::GoCommand go = mGo;
+            lock.unlock();
+
+            TimeManager timeManager;
+            SearchLimits limits = { .maxNodes = 1, .hashMb = 1, .searchMoves = go.searchMoves };
+            mContext.setOutput(nullptr);
+            auto [bestMove, ponderMove, nodes] = mContext.search(mBoard, timeManager, limits);
+            mContext.setOutput(&mOutput);
+            mContext.releaseTree();
+
+            lock.lock();
+            finishSearch(bestmoveLine(bestMove, ponderMove));
+            return;
+        }
+
+        mStopRequested = true;
+        mContext.stop();
+
+        if (mHeldBestmove != "")
+            finishSearch(mHeldBestmove);
+
+        mSearchCv.wait(lock, [&] { return !mBusy; });
+    }
+
+    inline void ponderhit()
+    {
+        std::lock_guard<std::mutex> lock(mSearchMutex);
+
+        if (!mBusy) return;
+
+        if (!mStarted)
+            mGo.isPonder = false;
+        else
+            mTimeManager.ponderhit();
+
+        if (mHeldBestmove != "")
+            finishSearch(mHeldBestmove);
+    }
+
+    // Pondering, or no clock, time, node or depth limit (go infinite, bare go without MaxMoveTime): runs until stop or ponderhit
+    inline bool isUnbounded(const uci::GoCommand &go)
+    {
+        return go.isPonder
+            || (go.milliseconds == I64_MAX && go.moveTimeMs == I64_MAX
+                && go.maxNodes == (u64)I64_MAX && go.maxDepth == (u64)I64_MAX
+                && (go.isInfinite || mMaxMoveTimeMs == 0));
+    }
+
+    inline void go(std::vector<std::string> &tokens)
+    {
+        uci::GoCommand go = uci::parseGo(tokens, mBoard);
+
+        if (mMaxNodes > 0)
+            go.maxNodes = std::min<u64>(go.maxNodes, mMaxNodes);
+
+        u64 searchId;
+
+        {
+            std::lock_guard<std::mutex> lock(mSearchMutex);
+            searchId = ++mSearchId;
+            mGo = go;
+            mBusy = true;
+            mStarted = false;
+            mStopRequested = false;
+            mHeldBestmove = "";
+            mQueuedTime = std::chrono::steady_clock::now();
+            mContext.clearStop();
+        }
+
+        std::shared_ptr<Session> self = shared_from_this();
+
+        if (isUnbounded(go))
+            std::thread([self, searchId] () { self->runSearch(searchId); }).detach();
+        else
+            mPool.submit([self, searchId] () { self->runSearch(searchId); });
+    }
+
+    // Returns false, leaving the board as it was, if the FEN or a move is invalid
+    inline bool position(std::vector<std::string> &tokens)
+    {
+        u64 movesIdx = std::find(tokens.begin(), tokens.end(), "moves") - tokens.begin();
+        Board board;
+
+        if (tokens.size() >= 2 && tokens[1] == "startpos")
+            board = Board(START_FEN);
+        else if (tokens.size() >= 3 && tokens[1] == "fen")
+        {
+            std::string fen = tokens[2];
+
+            for (u64 i = 3; i < movesIdx; i++)
+                fen += " " + tokens[i];
+
+            if (!isValidFen(fen)) return false;
+
+            board = Board(fen);
+        }
+        else
+            return false;
+
+        for (u64 i = movesIdx + 1; i < tokens.size(); i++)
+        {
+            Move move = board.legalMoveFromUci(tokens[i]);
+
+            if (move == MOVE_NONE) return false;
+
+            board.makeMove(move);
+        }
+
+        mBoard = board;
+        return true;
+    }
+
+    inline void uci()
+    {
+        send("id name New Century\n"
+             "id author zzzzz\n"
+             "option name Hash type spin default " + std::to_string(DEFAULT_SESSION_HASH_MB) + " min 1 max 1048576\n"
+             "option name MoveOverhead type spin default " + std::to_string(DEFAULT_MOVE_OVERHEAD_MS) + " min 0 max 5000\n"
+             "option name MultiPV type spin default 1 min 1 max 256\n"
+             "option name MaxNodes type spin default 0 min 0 max 1000000000\n"
+             "option name MaxMoveTime type spin default 0 min 0 max 1000000000\n"
+             "uciok");
+    }
+
+    inline void setoption(std::vector<std::string> &tokens)
+    {
+        std::string optionName = tokens[2];
+        trim(optionName);
+        std::string optionValue = tokens[4];
+        trim(optionValue);
+
+        auto tunableParams = mContext.params().tunableParams();
+
+        if (optionName == "Hash" || optionName == "hash")
+            mHashMb = std::clamp<i64>(stoll(optionValue), 1, 1048576);
+        else if (optionName == "MoveOverhead" || optionName == "moveoverhead")
+            mMoveOverheadMs = std::clamp<i64>(stoll(optionValue), 0, 5000);
+        else if (optionName == "MultiPV" || optionName == "multipv")
+            mMultiPv = std::clamp<i64>(stoll(optionValue), 1, 256);
+        else if (optionName == "MaxNodes" || optionName == "maxnodes")
+            mMaxNodes = std::max<i64>(stoll(optionValue), 0);
+        else if (optionName == "MaxMoveTime" || optionName == "maxmovetime")
+            mMaxMoveTimeMs = std::max<i64>(stoll(optionValue), 0);
+        else if (tunableParams.count(optionName) > 0) // evals are cached by evaluator configuration, see SearchContext
+        {
+            i64 newValue = stoll(optionValue);
+
+            std::visit([newValue] (auto *myParam)
+            {
+                myParam->value = std::is_same<decltype(myParam->value), double>::value
+                                 || std::is_same<decltype(myParam->value), float>::value
+                                 ? (double)newValue / 100.0
+                                 : newValue;
+            }, tunableParams[optionName]);
+        }
+    }
+
+    // Returns false when the session ends
+    inline bool command(std::string &received)
+    {
+        trim(received);
+        std::vector<std::string> tokens = splitString(received, ' ');
+
+        if (received == "" || tokens.size() == 0)
+            return true;
+
+        if (received == "quit") {
+            stopAndWait();
+            return false;
+        }
+        else if (received == "uci")
+            uci();
+        else if (received == "isready")
+            send("readyok");
+        else if (received == "stop")
+            stopAndWait();
+        else if (received == "ponderhit")
+            ponderhit();
+        else if (tokens[0] == "setoption" && tokens.size() >= 5) {
+            stopAndWait();
+            setoption(tokens);
+        }
+        else if (received == "ucinewgame") {
+            stopAndWait();
+            mBoard = Board(START_FEN);
+            mTimeManager.clearSavedTime();
+        }
+        else if (tokens[0] == "position") {
+            stopAndWait();
+
+            if (!position(tokens))
+                send("info string invalid position, ignored: " + received);
+        }
+        else if (tokens[0] == "go") {
+            stopAndWait();
+            go(tokens);
+        }
+
+        return true;
+    }
+
+    public:
+
+    inline Session(int fd, WorkerPool &pool, const SearchParams &params, EvalCache &sharedEvalCache)
+    : mFd(fd), mPool(pool), mContext(params, sharedEvalCache)
+    {
+        mContext.setOutput(&mOutput);
+    }
+
+    inline ~Session() { close(mFd); }
+
+    // Sends one or more lines, a newline is appended
+    // Thread safe; a closed connection is ignored, the session ends on its next read
+    inline void send(const std::string &lines)
+    {
+        std::string data = lines.back() == '\n' ? lines : lines + "\n";
+        std::lock_guard<std::mutex> lock(mSendMutex);
+
+        for (u64 sent = 0; sent < data.size(); )
+        {
+            ssize_t numSent = ::send(mFd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+
+            if (numSent <= 0) return;
+
+            sent += numSent;
+        }
+    }
+
+    // Reads commands until quit or disconnection, then waits for the session's search to end
+    inline void serve()
+    {
+        std::string pending = "";
+        std::array<char, 4096> buffer;
+
+        while (true)
+        {
+            ssize_t numRead = read(mFd, buffer.data(), buffer.size());
+
+            if (numRead <= 0) break;
+
+            pending.append(buffer.data(), numRead);
+
+            for (u64 newline = pending.find('\n'); newline != std::string::npos; newline = pending.find('\n'))
+            {
+                std::string line = pending.substr(0, newline);
+                pending.erase(0, newline + 1);
+
+                // A bad command is ignored, it must not take down the other sessions
+                try {
+                    if (!command(line)) {
+                        shutdown(mFd, SHUT_RDWR);
+                        return;
+                    }
+                }
+                catch (...) { }
+            }
+        }
+
+        stopAndWait();
+    }
+
+}; // class Session
+
+inline int SessionOutputBuf::sync()
+{
+    if (str().size() > 0) {
+        mSession.send(str());
+        str("");
+    }
+
+    return 0;
+}
+
+// Listens on 'socketPath' (replacing a stale socket file) until the process is killed or accept() fails for good
+// Every connection gets a thread that reads its commands, the searches run on the pool's 'numWorkers' threads
+inline void serve(const std::string &socketPath, u64 numWorkers)
+{
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+
+    if (socketPath.size() >= sizeof(address.sun_path)) {
+        std::cout << "Socket path too long: " << socketPath << std::endl;
+        return;
+    }
+
+    std::copy(socketPath.begin(), socketPath.end(), address.sun_path);
+
+    int listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(socketPath.c_str());
+
+    if (listenFd < 0
+    || bind(listenFd, (sockaddr*)&address, sizeof(address)) < 0
+    || listen(listenFd, SOMAXCONN) < 0)
+    {
+        std::cout << "Can't listen on " << socketPath << std::endl;
+        return;
+    }
+
+    WorkerPool pool(numWorkers);
+    EvalCache sharedEvalCache(DEFAULT_SHARED_EVAL_CACHE_MB);
+    const SearchParams params = SearchParams();
+
+    std::cout << "Serving on " << socketPath << " with " << std::max<u64>(numWorkers, 1) << " workers" << std::endl;
+
+    // Out of descriptors or memory: wait for sessions to end, backing off up to MAX_ACCEPT_BACKOFF_MS
+    u64 backoffMs = 0;
+
+    while (true)
+    {
+        int fd = accept(listenFd, nullptr, nullptr);
+
+        if (fd < 0)
+        {
+            int error = errno;
+
+            // Interrupted by a signal, or the connection was reset while queued
+            if (error == EINTR || error == ECONNABORTED) continue;
+
+            std::cout << "accept failed: " << strerror(error) << std::endl;
+
+            if (error != EMFILE && error != ENFILE && error != ENOBUFS && error != ENOMEM) {
+                close(listenFd);
+                return;
+            }
+
+            backoffMs = std::clamp<u64>(backoffMs * 2, 10, MAX_ACCEPT_BACKOFF_MS);
+            std::this_thread::sleep_for(std::chrono::milliseconds(backoffMs));
+            continue;
+        }
+
+        backoffMs = 0;
+
+        std::shared_ptr<Session> session = std::make_shared<Session>(fd, pool, params, sharedEvalCache);
+        std::thread([session] () { session->serve(); }).detach();
+    }
+}
+
+} // namespace server
@@ -0,0 +1,184 @@
+// clang-format off
+
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "move.hpp"
+
+constexpr u64 DEFAULT_MOVE_OVERHEAD_MS = 10;
+
+class TimeManager {
+    private:
+
+    constexpr static i64 DEFAULT_MOVES_TO_GO = 25;
+
+    // Below this share of the root visits, the best move is considered unstable
+    constexpr static double STABLE_BEST_SHARE = 0.5;
+
+    std::atomic<i64> mStartTimeNs = 0;
+    u64 mSoftMs = I64_MAX;
+    u64 mHardMs = I64_MAX;
+    bool mClockManaged = false; // limits from the game clock (not movetime)
+
+    // While pondering, no limit applies; ponderhit restarts the clock
+    std::atomic<bool> mPondering = false;
+
+    Move mBestMove = MOVE_NONE;
+    u64 mLastBestMoveChangeMs = 0;
+
+    // Time saved by stopping early, a part of it is spent on each of the next moves
+    u64 mSavedMs = 0;
+
+    std::thread mWatchdog;
+    std::mutex mWatchdogMutex;
+    std::condition_variable mWatchdogCv;
+    bool mWatchdogExit = false;
+
+    inline static i64 nowNs() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    public:
+
+    inline TimeManager() { mStartTimeNs = nowNs(); }
+
+    inline ~TimeManager() { stopWatchdog(); }
+
+    // Values of I64_MAX (or 0 for movesToGo) mean not given
+    inline void init(i64 timeLeftMs, i64 incrementMs, i64 movesToGo, i64 moveTimeMs, u64 moveOverheadMs, bool ponder)
+    {
+        mStartTimeNs = nowNs();
+        mPondering = ponder;
+        mBestMove = MOVE_NONE;
+        mLastBestMoveChangeMs = 0;
+        mSoftMs = mHardMs = I64_MAX;
+        mClockManaged = false;
+
+        if (moveTimeMs != I64_MAX) {
+            mSoftMs = mHardMs = std::max<i64>(moveTimeMs - (i64)moveOverheadMs, 1);
+            return;
+        }
+
+        if (timeLeftMs == I64_MAX) return;
+
+        mClockManaged = true;
+        i64 available = std::max<i64>(timeLeftMs - (i64)moveOverheadMs, 1);
+        i64 increment = incrementMs == I64_MAX ? 0 : std::max<i64>(incrementMs, 0);
+        i64 mtg = movesToGo > 0 ? std::min<i64>(movesToGo, 50) : DEFAULT_MOVES_TO_GO;
+
+        // With one move to go, the clock is refilled after this move
+        double maxShare = mtg == 1 ? 0.9 : 0.5;
+
+        i64 optimum = available / mtg + increment * 3 / 4;
+        mHardMs = std::max<i64>(std::min<i64>(optimum * 4, available * maxShare), 1);
+
+        u64 savedBonus = std::min<u64>(mSavedMs / 4, optimum);
+        mSavedMs -= savedBonus;
+
+        mSoftMs = std::min<i64>(optimum + savedBonus, mHardMs);
+    }
+
+    // Caps the search time (after init), keeping the clock's limits if they're lower
+    inline void capTime(u64 maxMs)
+    {
+        mHardMs = std::min<u64>(mHardMs, std::max<u64>(maxMs, 1));
+        mSoftMs = std::min<u64>(mSoftMs, mHardMs);
+    }
+
+    inline void addSavedTime(u64 savedMs) { mSavedMs += savedMs; }
+
+    inline void clearSavedTime() { mSavedMs = 0; }
+
+    inline bool isLimited() { return mHardMs != (u64)I64_MAX; }
+
+    // Playing a game on the clock: time not spent is saved for later moves, e.g. a forced move is played at once
+    inline bool isClockManaged() { return mClockManaged; }
+
+    inline bool isPondering() { return mPondering; }
+
+    inline void ponderhit() {
+        mStartTimeNs = nowNs();
+        mPondering = false;
+    }
+
+    inline u64 elapsedMs() {
+        return std::max<i64>(nowNs() - mStartTimeNs, 0) / 1'000'000;
+    }
+
+    inline u64 softLimitMs() { return mSoftMs; }
+
+    inline u64 hardLimitMs() { return mHardMs; }
+
+    inline bool hardLimitReached() {
+        return !mPondering && elapsedMs() >= mHardMs;
+    }
+
+    // Past the soft limit, keep searching (up to the hard limit) while the most visited root move
+    // changed recently or holds a small share of the root visits
+    inline bool softLimitReached(Move bestMove, double bestShare)
+    {
+        if (mPondering) return false;
+
+        u64 elapsed = elapsedMs();
+
+        if (bestMove != mBestMove) {
+            mBestMove = bestMove;
+            mLastBestMoveChangeMs = elapsed;
+        }
+
+        if (elapsed >= mHardMs) return true;
+        if (elapsed < mSoftMs) return false;
+
+        double scale = 1.0;
+
+        if (elapsed - mLastBestMoveChangeMs < mSoftMs / 4)
+            scale += 0.5;
+
+        if (bestShare < STABLE_BEST_SHARE)
+            scale += (STABLE_BEST_SHARE - bestShare) * 2.0;
+
+        return elapsed >= std::min<double>(mSoftMs * scale, mHardMs);
+    }
+
+    // Sets 'stop' at the hard limit, even if an iteration is slow
+    inline void startWatchdog(std::atomic<bool> &stop)
+    {
+        if (!isLimited()) return;
+
+        mWatchdogExit = false;
+
+        mWatchdog = std::thread([this, &stop] ()
+        {
+            std::unique_lock<std::mutex> lock(mWatchdogMutex);
+
+            while (!mWatchdogExit)
+            {
+                if (hardLimitReached()) {
+                    stop = true;
+                    return;
+                }
+
+                u64 waitMs = mPondering ? 1 : std::max<i64>((i64)mHardMs - (i64)elapsedMs(), 1);
+                mWatchdogCv.wait_for(lock, std::chrono::milliseconds(waitMs));
+            }
+        });
+    }
+
+    inline void stopWatchdog()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mWatchdogMutex);
+            mWatchdogExit = true;
+        }
+
+        mWatchdogCv.notify_all();
+
+        if (mWatchdog.joinable())
+            mWatchdog.join();
+    }
+
+}; // class TimeManager
@@ -0,0 +1,288 @@
+// clang-format off
+
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include "node.hpp"
+
+// Concurrent hash table of DAG nodes keyed by zobrist hash
+// Sharded so that threads only contend when they hit the same shard
+class NodeTable {
+    private:
+
+    constexpr static u64 NUM_SHARDS = 64;
+
+    public:
+
+    // Approximate memory of an entry (hash node, bucket pointer and allocator overhead)
+    constexpr static u64 ENTRY_BYTES = 48;
+
+    private:
+
+    struct alignas(64) Shard {
+        std::mutex mMutex;
+        std::unordered_map<u64, Node*> mNodes = {};
+    };
+
+    std::array<Shard, NUM_SHARDS> mShards = {};
+
+    inline Shard& shard(u64 key) { return mShards[key % NUM_SHARDS]; }
+
+    public:
+
+    inline Node* find(u64 key)
+    {
+        Shard &shard = this->shard(key);
+        std::lock_guard<std::mutex> lock(shard.mMutex);
+
+        auto it = shard.mNodes.find(key);
+        return it == shard.mNodes.end() ? nullptr : it->second;
+    }
+
+    // Returns the node already stored with this key, or stores and returns 'node'
+    inline Node* insert(u64 key, Node *node)
+    {
+        Shard &shard = this->shard(key);
+        std::lock_guard<std::mutex> lock(shard.mMutex);
+
+        auto [it, inserted] = shard.mNodes.try_emplace(key, node);
+        return it->second;
+    }
+
+    inline void erase(u64 key)
+    {
+        Shard &shard = this->shard(key);
+        std::lock_guard<std::mutex> lock(shard.mMutex);
+        shard.mNodes.erase(key);
+    }
+
+    inline void clear() {
+        for (Shard &shard : mShards) {
+            std::lock_guard<std::mutex> lock(shard.mMutex);
+            shard.mNodes.clear();
+        }
+    }
+
+}; // class NodeTable
+
+// Owns all the nodes of a search
+// In DAG mode, transpositions share a single node
+// Memory is capped: when full, the least visited subtrees are pruned
+class Tree {
+    private:
+
+    std::deque<Node> mNodes = {};
+    std::vector<Node*> mFreeNodes = {};
+    NodeTable mTable;
+    History mHistory;
+    const SearchParams *mParams = nullptr;
+    bool mDagMode = false;
+
+    u64 mBytesUsed = 0;
+    u64 mMaxBytes = I64_MAX;
+    bool mFull = false; // garbage collection couldn't free enough memory, stop expanding
+    u32 mGcEpoch = 0;
+
+    constexpr static u32 FREE_NODE = 0xFFFF'FFFF;
+
+    // Near the 50-move draw, a position's value depends on the halfmove clock,
+    // so the clock becomes part of the key and those nodes are only shared when the clocks match
+    // Below that, edges may lead to a subtree reached with another clock: the draw itself is
+    // checked on the selection path (SearchContext::isPathDraw), so no node stores it
+    constexpr static u8 SHARE_PLIES_LIMIT = 80;
+
+    inline u64 nodeKey(Board &board) {
+        u64 key = board.zobristHash();
+
+        if (board.pliesSincePawnOrCapture() >= SHARE_PLIES_LIMIT)
+            key ^= (board.pliesSincePawnOrCapture() + 1) * 0x9E3779B97F4A7C15ULL;
+
+        return key;
+    }
+
+    inline u64 nodeBytes(Node &node) {
+        return sizeof(Node)
+               + node.mEdges.capacity() * sizeof(Edge)
+               + (mDagMode ? NodeTable::ENTRY_BYTES : 0);
+    }
+
+    inline Node* newNode(Board &board, bool isRoot)
+    {
+        Node *node;
+
+        if (mFreeNodes.size() > 0) {
+            node = mFreeNodes.back();
+            mFreeNodes.pop_back();
+            *node = Node(board, isRoot, !mDagMode, mHistory, *mParams);
+        }
+        else {
+            mNodes.push_back(Node(board, isRoot, !mDagMode, mHistory, *mParams));
+            node = &mNodes.back();
+        }
+
+        mBytesUsed += nodeBytes(*node);
+        return node;
+    }
+
+    inline void freeNode(Node &node)
+    {
+        mBytesUsed -= nodeBytes(node);
+
+        if (mDagMode) mTable.erase(node.mKey);
+
+        std::vector<Edge>().swap(node.mEdges);
+        node.mGcEpoch = FREE_NODE;
+        mFreeNodes.push_back(&node);
+    }
+
+    public:
+
+    inline Tree() = default;
+
+    inline Node* root() { return &mNodes.front(); }
+
+    inline bool dagMode() { return mDagMode; }
+
+    inline History& history() { return mHistory; }
+
+    inline u64 numNodes() { return mNodes.size() - mFreeNodes.size(); }
+
+    inline u64 bytesUsed() { return mBytesUsed; }
+
+    inline bool canExpand() { return !mFull; }
+
+    // Permille of the memory limit in use
+    inline int hashfull() {
+        return std::min<u64>(1000, (u128)mBytesUsed * 1000 / std::max<u64>(mMaxBytes, 1));
+    }
+
+    // The nodes are created with 'params', which must outlive the tree's use
+    inline void reset(Board &rootBoard, const SearchParams &params, u64 maxBytes)
+    {
+        mNodes.clear();
+        mFreeNodes.clear();
+        mTable.clear();
+        mHistory.clear();
+        mParams = &params;
+        mDagMode = params.DAG_MODE() > 0;
+        mBytesUsed = 0;
+        mMaxBytes = maxBytes;
+        mFull = false;
+        mGcEpoch = 0;
+        newNode(rootBoard, true);
+    }
+
+    // Frees the memory of all the nodes, the tree must be reset before its next use
+    inline void release()
+    {
+        std::deque<Node>().swap(mNodes);
+        std::vector<Node*>().swap(mFreeNodes);
+        mTable.clear();
+        mBytesUsed = 0;
+    }
+
+    // Create the child for the position on the board
+    // In DAG mode, returns the existing node if this position has already been reached
+    inline Node* expand(Board &board, bool &isTransposition)
+    {
+        isTransposition = false;
+
+        if (!mDagMode)
+            return newNode(board, false);
+
+        u64 key = nodeKey(board);
+        Node *node = mTable.find(key);
+
+        if (node != nullptr) {
+            isTransposition = true;
+            return node;
+        }
+
+        node = newNode(board, false);
+        node->mKey = key;
+
+        Node *stored = mTable.insert(key, node);
+
+        // Another thread stored this position first
+        if (stored != node) {
+            mBytesUsed -= nodeBytes(*node);
+            std::vector<Edge>().swap(node->mEdges);
+            node->mGcEpoch = FREE_NODE;
+            mFreeNodes.push_back(node);
+            isTransposition = true;
+        }
+
+        return stored;
+    }
+
+    // Call between iterations (never while holding a selection path)
+    // If over the memory limit, prune the least visited subtrees until usage drops to 3/4 of the limit
+    // Each pass prunes the nodes estimated to free enough memory; if they weren't enough (e.g. the small nodes went first),
+    // the next pass raises the visits threshold over the remaining nodes
+    // Pruned edges keep their statistics and are expanded again if selected
+    inline void collectGarbage()
+    {
+        if (mBytesUsed <= mMaxBytes || mFull) return;
+
+        u64 targetBytes = mMaxBytes / 4 * 3;
+        std::vector<u32> visits;
+
+        while (mBytesUsed > targetBytes)
+        {
+            u64 bytesBefore = mBytesUsed;
+            u64 liveNodes = numNodes();
+
+            // Nodes with at most 'maxPrunedVisits' visits get pruned
+            visits.clear();
+            visits.reserve(liveNodes);
+
+            for (u64 i = 1; i < mNodes.size(); i++)
+                if (mNodes[i].mGcEpoch != FREE_NODE)
+                    visits.push_back(mNodes[i].mVisits);
+
+            if (visits.size() == 0) break; // only the root is left
+
+            u64 avgNodeBytes = std::max<u64>(mBytesUsed / liveNodes, 1);
+            u64 numToFree = (mBytesUsed - targetBytes + avgNodeBytes - 1) / avgNodeBytes;
+            numToFree = std::clamp<u64>(numToFree, 1, visits.size());
+
+            std::nth_element(visits.begin(), visits.begin() + (numToFree - 1), visits.end());
+            u32 maxPrunedVisits = visits[numToFree - 1];
+
+            // Mark reachable nodes, detaching the pruned children
+            mGcEpoch++;
+            std::vector<Node*> stack = { root() };
+            root()->mGcEpoch = mGcEpoch;
+
+            while (stack.size() > 0)
+            {
+                Node *node = stack.back();
+                stack.pop_back();
+
+                for (Edge &edge : node->mEdges)
+                {
+                    if (edge.mChild == nullptr) continue;
+
+                    if (edge.mChild->mVisits <= maxPrunedVisits)
+                        edge.mChild = nullptr;
+                    else if (edge.mChild->mGcEpoch != mGcEpoch) {
+                        edge.mChild->mGcEpoch = mGcEpoch;
+                        stack.push_back(edge.mChild);
+                    }
+                }
+            }
+
+            // Sweep unreachable nodes
+            for (Node &node : mNodes)
+                if (node.mGcEpoch != FREE_NODE && node.mGcEpoch != mGcEpoch)
+                    freeNode(node);
+
+            if (mBytesUsed == bytesBefore) break;
+        }
+
+        // Still over the limit with nothing left to prune (e.g. a huge root): stop expanding
+        mFull = mBytesUsed > mMaxBytes;
+    }
+
+}; // class Tree
@@ -0,0 +1,154 @@
+// clang-format off
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include "move.hpp"
+
+// Transposition table of the alpha-beta engine, shared by all its threads (Lazy SMP)
+// Each entry is a single atomic u64 (16 bits of key, move, score, depth, generation and bound),
+// so it's lock-free and a torn entry can't happen; entries are grouped in clusters of one cache line
+// The stored move may come from another position (key collision), so it must be checked against the legal moves
+class TranspositionTable {
+    public:
+
+    enum class Bound : u8 { NONE = 0, EXACT = 1, LOWER = 2, UPPER = 3 };
+
+    struct Entry {
+        Move move = MOVE_NONE;
+        i16 score = 0;
+        u8 depth = 0;
+        Bound bound = Bound::NONE;
+    };
+
+    private:
+
+    constexpr static u64 ENTRIES_PER_CLUSTER = 8;
+
+    struct alignas(64) Cluster {
+        std::array<std::atomic<u64>, ENTRIES_PER_CLUSTER> mEntries;
+    };
+
+    static_assert(sizeof(Cluster) == 64);
+
+    std::unique_ptr<Cluster[]> mClusters = nullptr;
+    u64 mNumClusters = 0;
+    u64 mSizeMb = 0;
+
+    u8 mGeneration = 0; // 6 bits, incremented every search
+
+    // key 16 | move 16 | score 16 | depth 8 | generation 6, bound 2
+    inline static u64 pack(u16 key, Move move, i16 score, u8 depth, u8 generation, Bound bound) {
+        return ((u64)key << 48) | ((u64)move.encoded() << 32) | ((u64)(u16)score << 16)
+               | ((u64)depth << 8) | ((u64)generation << 2) | (u64)bound;
+    }
+
+    inline static u16 key(u64 hash) { return (u16)hash; }
+
+    inline static u16 entryKey(u64 data) { return data >> 48; }
+
+    inline static u8 entryDepth(u64 data) { return (data >> 8) & 0xFF; }
+
+    inline static u8 entryGeneration(u64 data) { return (data >> 2) & 0b111111; }
+
+    inline Cluster& cluster(u64 hash) {
+        return mClusters[(u128)hash * (u128)mNumClusters >> 64];
+    }
+
+    public:
+
+    inline u64 sizeMb() { return mSizeMb; }
+
+    // Allocated on the first search, not at startup
+    inline void resize(u64 sizeMb)
+    {
+        mSizeMb = sizeMb;
+        mNumClusters = std::max<u64>(sizeMb * 1024 * 1024 / sizeof(Cluster), 1);
+        mClusters = std::make_unique<Cluster[]>(mNumClusters);
+        clear();
+    }
+
+    inline void clear()
+    {
+        for (u64 i = 0; i < mNumClusters; i++)
+            for (std::atomic<u64> &entry : mClusters[i].mEntries)
+                entry.store(0, std::memory_order_relaxed);
+
+        mGeneration = 0;
+    }
+
+    inline void newSearch() { mGeneration = (mGeneration + 1) % 64; }
+
+    inline bool probe(u64 hash, Entry &entry)
+    {
+        for (std::atomic<u64> &atomicEntry : cluster(hash).mEntries)
+        {
+            u64 data = atomicEntry.load(std::memory_order_relaxed);
+
+            if (data != 0 && entryKey(data) == key(hash)) {
+                entry.move = Move((u16)(data >> 32));
+                entry.score = (i16)(u16)(data >> 16);
+                entry.depth = entryDepth(data);
+                entry.bound = (Bound)(data & 0b11);
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    // Replaces the entry with the same key, else the one with the lowest depth minus age
+    // A move-less store keeps the move already stored for the position
+    inline void store(u64 hash, Move move, i16 score, u8 depth, Bound bound)
+    {
+        Cluster &cluster = this->cluster(hash);
+        std::atomic<u64> *replace = nullptr;
+        i32 worstValue = I32_MAX;
+        u64 replaceData = 0;
+
+        for (std::atomic<u64> &entry : cluster.mEntries)
+        {
+            u64 data = entry.load(std::memory_order_relaxed);
+
+            if (data == 0 || entryKey(data) == key(hash)) {
+                replace = &entry;
+                replaceData = data;
+                break;
+            }
+
+            i32 age = (64 + mGeneration - entryGeneration(data)) % 64;
+            i32 value = (i32)entryDepth(data) - 8 * age;
+
+            if (value < worstValue) {
+                worstValue = value;
+                replace = &entry;
+                replaceData = data;
+            }
+        }
+
+        if (move == MOVE_NONE && replaceData != 0 && entryKey(replaceData) == key(hash))
+            move = Move((u16)(replaceData >> 32));
+
+        replace->store(pack(key(hash), move, score, depth, mGeneration, bound), std::memory_order_relaxed);
+    }
+
+    // Permille of the sampled entries written in the current search
+    inline int hashfull()
+    {
+        u64 numSampled = std::min<u64>(1000 / ENTRIES_PER_CLUSTER, mNumClusters);
+        u64 numFull = 0;
+
+        for (u64 i = 0; i < numSampled; i++)
+            for (std::atomic<u64> &entry : mClusters[i].mEntries) {
+                u64 data = entry.load(std::memory_order_relaxed);
+                numFull += data != 0 && entryGeneration(data) == mGeneration;
+            }
+
+        return numFull * 1000 / std::max<u64>(numSampled * ENTRIES_PER_CLUSTER, 1);
+    }
+
+}; // class TranspositionTable
+
+// Persists across searches, cleared on ucinewgame
+TranspositionTable tt;
@@ -2,18 +2,45 @@
 
 #pragma once
 
+#include <thread>
 #include "board.hpp"
 #include "perft.hpp"
 #include "search.hpp"
 #include "bench.hpp"
+#include "analyse.hpp"
+#include "datagen.hpp"
+#include "dfpn.hpp"
 
 namespace uci { // Universal chess interface
 
+u64 hashMb = DEFAULT_HASH_MB;
+u64 moveOverheadMs = DEFAULT_MOVE_OVERHEAD_MS;
+u64 multiPv = 1;
+u64 numThreads = 1; // only the alpha-beta engine is multithreaded
+
+TimeManager timeManager;
+
+// MCTS search state and the tunable parameters (also read by the alpha-beta engine)
+SearchContext searchContext;
+
+std::thread searchThread;
+
 inline void uci();
 inline void setoption(std::vector<std::string> &tokens);
 inline void position(std::vector<std::string> &tokens, Board &board);
 inline void go(std::vector<std::string> &tokens, Board &board);
 
+// Stop the search (if running) and wait for its thread to end
+inline void stopAndJoin()
+{
+    stopSearch = true;
+    searchContext.stop();
+    timeManager.ponderhit();
+
+    if (searchThread.joinable()) 
+        searchThread.join();
+}
+
 inline void uciLoop()
 {
     Board board = Board(START_FEN);
@@ -29,45 +56,134 @@ inline void uciLoop()
 
         try {
 
-        if (received == "quit" || !std::cin.good())
+        if (received == "quit" || !std::cin.good()) {
+            stopAndJoin();
             break;
+        }
         else if (received == "uci")
             uci();
-        else if (tokens[0] == "setoption") // e.g. "setoption name Hash value 32"
-            setoption(tokens);
-        else if (received == "ucinewgame")
-            board = Board(START_FEN);
         else if (received == "isready")
             std::cout << "readyok" << std::endl;
-        else if (tokens[0] == "position")
+        else if (received == "stop")
+            stopAndJoin();
+        else if (received == "ponderhit")
+            timeManager.ponderhit();
+        else if (tokens[0] == "setoption") { // e.g. "setoption name Hash value 32"
+            stopAndJoin();
+            setoption(tokens);
+        }
+        else if (received == "ucinewgame") {
+            stopAndJoin();
+            board = Board(START_FEN);
+            timeManager.clearSavedTime();
+            searchContext.evalCache().clear();
+            tt.clear();
+            dfpn::mateTable.clear();
+        }
+        else if (tokens[0] == "position") {
+            stopAndJoin();
             position(tokens, board);
-        else if (tokens[0] == "go")
+        }
+        else if (tokens[0] == "go" && tokens.size() > 1 && tokens[1] == "perft")
+        {
+            stopAndJoin();
+            int depth = stoi(tokens.back());
+            perftBench(board, depth);
+        }
+        else if (tokens[0] == "go") {
+            stopAndJoin();
             go(tokens, board);
+        }
         else if (tokens[0] == "print" || tokens[0] == "d"
         || tokens[0] == "display" || tokens[0] == "show")
             board.print();
         else if (tokens[0] == "bench")
         {
+            stopAndJoin();
+
             if (tokens.size() == 1)
-                bench();
+                bench(0, searchContext.params());
             else {
                 int depth = stoi(tokens[1]);
-                bench(depth);
+                bench(depth, searchContext.params());
+            }
+        }
+        else if (tokens[0] == "analyse" && tokens.size() > 1)
+        {
+            // e.g. "analyse positions.epd nodes 10000 threads 8 out results.jsonl format json"
+            stopAndJoin();
+            u64 maxNodes = I64_MAX, moveTimeMs = I64_MAX, analyseThreads = 1;
+            std::string outPath = "analyse.jsonl";
+            analyse::OutputFormat format = analyse::OutputFormat::JSON;
+
+            for (u64 i = 2; i + 1 < tokens.size(); i += 2)
+            {
+                if (tokens[i] == "nodes")
+                    maxNodes = std::max<i64>(stoll(tokens[i + 1]), 1);
+                else if (tokens[i] == "movetime")
+                    moveTimeMs = std::max<i64>(stoll(tokens[i + 1]), 1);
+                else if (tokens[i] == "threads")
+                    analyseThreads = std::clamp<i64>(stoll(tokens[i + 1]), 1, 1024);
+                else if (tokens[i] == "out")
+                    outPath = tokens[i + 1];
+                else if (tokens[i] == "format" && tokens[i + 1] == "binary")
+                    format = analyse::OutputFormat::BINARY;
+            }
+
+            if (maxNodes == (u64)I64_MAX && moveTimeMs == (u64)I64_MAX)
+                std::cout << "info string analyse needs nodes or movetime" << std::endl;
+            else
+                analyse::analyse(tokens[1], maxNodes, moveTimeMs, analyseThreads, outPath, format, 
+                                 searchContext.params(), hashMb);
+        }
+        else if (tokens[0] == "datagen")
+        {
+            // e.g. "datagen nodes 1000 games 10000 threads 8 out games.bin openingplies 8 seed 1"
+            stopAndJoin();
+            u64 maxNodes = 0, numGames = 0, openingPlies = datagen::DEFAULT_OPENING_PLIES;
+            u64 datagenThreads = std::max<u64>(std::thread::hardware_concurrency(), 1);
+            u64 seed = std::chrono::steady_clock::now().time_since_epoch().count();
+            std::string outPath = "datagen.bin";
+
+            for (u64 i = 1; i + 1 < tokens.size(); i += 2)
+            {
+                if (tokens[i] == "nodes")
+                    maxNodes = std::max<i64>(stoll(tokens[i + 1]), 1);
+                else if (tokens[i] == "games")
+                    numGames = std::max<i64>(stoll(tokens[i + 1]), 1);
+                else if (tokens[i] == "threads")
+                    datagenThreads = std::clamp<i64>(stoll(tokens[i + 1]), 1, 1024);
+                else if (tokens[i] == "out")
+                    outPath = tokens[i + 1];
+                else if (tokens[i] == "openingplies")
+                    openingPlies = std::clamp<i64>(stoll(tokens[i + 1]), 0, 100);
+                else if (tokens[i] == "seed")
+                    seed = stoull(tokens[i + 1]);
             }
+
+            if (maxNodes == 0 || numGames == 0)
+                std::cout << "info string datagen needs nodes and games" << std::endl;
+            else
+                datagen::datagen(maxNodes, numGames, datagenThreads, outPath, openingPlies, seed, 
+                                 searchContext.params(), hashMb);
         }
-        else if (tokens[0] == "perft" || (tokens[0] == "go" && tokens[1] == "perft"))
+        else if (tokens[0] == "perft")
         {
+            stopAndJoin();
             int depth = stoi(tokens.back());
             perftBench(board, depth);
         }
         else if (tokens[0] == "perftsplit" || tokens[0] == "splitperft" 
         || tokens[0] == "perftdivide" || tokens[0] == "divideperft")
         {
+            stopAndJoin();
             int depth = stoi(tokens[1]);
             perftSplit(board, depth);
         }
-        else if (tokens[0] == "makemove")
+        else if (tokens[0] == "makemove") {
+            stopAndJoin();
             board.makeMove(tokens[1]);
+        }
 
         } 
         catch (const char* errorMessage)
@@ -81,8 +197,26 @@ inline void uci() {
     std::cout << "id name New Century" << std::endl;
     std::cout << "id author zzzzz" << std::endl;
 
+    std::cout << "option name Hash type spin default " << DEFAULT_HASH_MB 
+              << " min 1 max 1048576" << std::endl;
+
+    std::cout << "option name MoveOverhead type spin default " << DEFAULT_MOVE_OVERHEAD_MS 
+              << " min 0 max 5000" << std::endl;
+
+    std::cout << "option name EvalCache type spin default " << DEFAULT_EVAL_CACHE_MB 
+              << " min 1 max 65536" << std::endl;
+
+    std::cout << "option name MultiPV type spin default 1 min 1 max 256" << std::endl;
+
+    std::cout << "option name Engine type combo default MCTS var MCTS var AlphaBeta" << std::endl;
+
+    std::cout << "option name MateHash type spin default " << dfpn::DEFAULT_MATE_HASH_MB
+              << " min 1 max 65536" << std::endl;
+
+    std::cout << "option name Threads type spin default 1 min 1 max 1024" << std::endl;
+
     /*
-    for (auto [paramName, tunableParam] : tunableParams) {
+    for (auto [paramName, tunableParam] : searchContext.params().tunableParams()) {
         std::cout << "option name " << paramName;
 
         std::visit([&] (auto *myParam) 
@@ -117,9 +251,45 @@ inline void setoption(std::vector<std::string> &tokens)
     std::string optionValue = tokens[4];
     trim(optionValue);
 
-    if (tunableParams.count(optionName) > 0) 
+    if (optionName == "Hash" || optionName == "hash")
     {
-        auto tunableParam = tunableParams[optionName];
+        hashMb = std::clamp<i64>(stoll(optionValue), 1, 1048576);
+        std::cout << "Hash set to " << hashMb << " MB" << std::endl;
+    }
+    else if (optionName == "MoveOverhead" || optionName == "moveoverhead")
+    {
+        moveOverheadMs = std::clamp<i64>(stoll(optionValue), 0, 5000);
+        std::cout << "MoveOverhead set to " << moveOverheadMs << " ms" << std::endl;
+    }
+    else if (optionName == "EvalCache" || optionName == "evalcache")
+    {
+        u64 sizeMb = std::clamp<i64>(stoll(optionValue), 1, 65536);
+        searchContext.evalCache().resize(sizeMb);
+        std::cout << "EvalCache set to " << sizeMb << " MB" << std::endl;
+    }
+    else if (optionName == "MultiPV" || optionName == "multipv")
+    {
+        multiPv = std::clamp<i64>(stoll(optionValue), 1, 256);
+        std::cout << "MultiPV set to " << multiPv << std::endl;
+    }
+    else if (optionName == "Engine" || optionName == "engine")
+    {
+        engine = optionValue == "AlphaBeta" || optionValue == "alphabeta" ? Engine::ALPHA_BETA : Engine::MCTS;
+        std::cout << "Engine set to " << (engine == Engine::ALPHA_BETA ? "AlphaBeta" : "MCTS") << std::endl;
+    }
+    else if (optionName == "MateHash" || optionName == "matehash")
+    {
+        dfpn::mateTableMb = std::clamp<i64>(stoll(optionValue), 1, 65536);
+        std::cout << "MateHash set to " << dfpn::mateTableMb << " MB" << std::endl;
+    }
+    else if (optionName == "Threads" || optionName == "threads")
+    {
+        numThreads = std::clamp<i64>(stoll(optionValue), 1, 1024);
+        std::cout << "Threads set to " << numThreads << std::endl;
+    }
+    else if (searchContext.params().tunableParams().count(optionName) > 0) 
+    {
+        auto tunableParam = searchContext.params().tunableParams()[optionName];
         i64 newValue = stoll(optionValue);
 
         std::visit([optionName, newValue] (auto *myParam) 
@@ -133,6 +303,12 @@ inline void setoption(std::vector<std::string> &tokens)
 
             std::cout << optionName << " set to " << myParam->value << std::endl;
         }, tunableParam);
+
+        // The cached evals were made by another evaluator configuration
+        // (they're keyed by it too, but would only take up space)
+        if (optionName == "EVAL_SCALE" || optionName == "LEAF_SEARCH" || optionName == "LEAF_SEARCH_DEPTH"
+        || optionName == "ROLLOUT_POLICY")
+            searchContext.evalCache().clear();
     }
 }
 
@@ -159,40 +335,111 @@ inline void position(std::vector<std::string> &tokens, Board &board)
         board.makeMove(tokens[i]);
 }
 
-inline void go(std::vector<std::string> &tokens, Board &board)
-{
+// Arguments of a go command, I64_MAX (or 0 for movesToGo and mateMoves) = not given
+struct GoCommand {
     i64 milliseconds = I64_MAX;
+    i64 incrementMs = I64_MAX;
+    i64 movesToGo = 0;
+    i64 moveTimeMs = I64_MAX;
     u64 maxDepth = I64_MAX;
     u64 maxNodes = I64_MAX;
-    bool isMoveTime = false;
+    i64 mateMoves = 0;
+    bool isInfinite = false;
+    bool isPonder = false;
+    std::vector<Move> searchMoves = {};
+};
+
+inline GoCommand parseGo(std::vector<std::string> &tokens, Board &board)
+{
+    GoCommand go;
 
-    for (int i = 1; i < (int)tokens.size() - 1; i += 2)
+    const std::vector<std::string> GO_KEYWORDS = { 
+        "searchmoves", "ponder", "wtime", "btime", "winc", "binc", 
+        "movestogo", "depth", "nodes", "mate", "movetime", "infinite" 
+    };
+
+    for (int i = 1; i < (int)tokens.size(); i++)
     {
+        // The moves run until the next keyword, illegal ones are dropped
+        if (tokens[i] == "searchmoves") {
+            while (i + 1 < (int)tokens.size() 
+            && std::find(GO_KEYWORDS.begin(), GO_KEYWORDS.end(), tokens[i + 1]) == GO_KEYWORDS.end())
+            {
+                Move move = board.legalMoveFromUci(tokens[++i]);
+
+                if (move != MOVE_NONE) go.searchMoves.push_back(move);
+            }
+
+            continue;
+        }
+
+        if (tokens[i] == "infinite") {
+            go.isInfinite = true;
+            continue;
+        }
+
+        if (tokens[i] == "ponder") {
+            go.isPonder = true;
+            continue;
+        }
+
+        if (i + 1 >= (int)tokens.size()) break;
+
         i64 value = std::stoll(tokens[i + 1]);
 
         if ((tokens[i] == "wtime" && board.sideToMove() == Color::WHITE) 
         ||  (tokens[i] == "btime" && board.sideToMove() == Color::BLACK))
-            milliseconds = std::max(value, (i64)0);
+            go.milliseconds = std::max(value, (i64)0);
 
+        else if ((tokens[i] == "winc" && board.sideToMove() == Color::WHITE) 
+        ||       (tokens[i] == "binc" && board.sideToMove() == Color::BLACK))
+            go.incrementMs = std::max(value, (i64)0);
+
+        else if (tokens[i] == "movestogo")
+            go.movesToGo = std::max(value, (i64)0);
         else if (tokens[i] == "movetime")
-            isMoveTime = true;
+            go.moveTimeMs = std::max(value, (i64)0);
         else if (tokens[i] == "depth")
-            maxDepth = std::max(value, (i64)1);
+            go.maxDepth = std::max(value, (i64)1);
         else if (tokens[i] == "nodes")
-            maxNodes = std::max(value, (i64)0);
+            go.maxNodes = std::max(value, (i64)0);
+        else if (tokens[i] == "mate")
+            go.mateMoves = std::max(value, (i64)1);
+
+        i++;
     }
 
-    u64 maxSearchTimeMs = std::max((i64)0, milliseconds - 10);
+    if (go.isInfinite)
+        go.milliseconds = go.moveTimeMs = I64_MAX;
 
-    u64 searchTimeMs = milliseconds == I64_MAX 
-                       ? I64_MAX
-                       : isMoveTime 
-                       ? maxSearchTimeMs
-                       : maxSearchTimeMs / 25.0;
+    return go;
+}
 
-    auto [bestMove, nodes] = search(board, searchTimeMs, maxDepth, maxNodes, true);
+inline void go(std::vector<std::string> &tokens, Board &board)
+{
+    GoCommand go = parseGo(tokens, board);
 
-    std::cout << "bestmove " << bestMove.toUci() << std::endl;
+    timeManager.init(go.milliseconds, go.incrementMs, go.movesToGo, go.moveTimeMs, moveOverheadMs, go.isPonder);
+    stopSearch = false;
+    searchContext.clearStop();
+
+    searchThread = std::thread([=] () 
+    {
+        // go mate N runs the proof-number search, whatever the engine
+        auto [bestMove, ponderMove, nodes] = go.mateMoves > 0
+            ? dfpn::search(board, timeManager, go.mateMoves, go.maxNodes, true)
+            : engine == Engine::ALPHA_BETA
+            ? ab::search(board, timeManager, go.maxDepth, go.maxNodes, true, hashMb, numThreads, go.searchMoves, searchContext.params())
+            : searchContext.search(board, timeManager, SearchLimits { go.maxDepth, go.maxNodes, hashMb, multiPv, go.searchMoves });
+
+        // In go infinite and go ponder, bestmove is only sent after stop or ponderhit
+        while ((go.isInfinite || timeManager.isPondering()) && !stopSearch)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+        std::cout << "bestmove " << bestMove.toUci()
+                  << (ponderMove != MOVE_NONE ? " ponder " + ponderMove.toUci() : "")
+                  << std::endl;
+    });
 }
 
 } // namespace uci
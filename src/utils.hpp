@@ -225,33 +225,36 @@ inline double ln(double x) {
     return log(x);
 }
 
-u64 rngX = 123456789, rngY = 362436069, rngZ = 521288629;
+// Xorshift generator, each user owns its state (e.g. one per search or per thread)
+struct Rng {
+    public:
 
-inline void resetRng() {
-    rngX = 123456789;
-    rngY = 362436069;
-    rngZ = 521288629;
-}
+    u64 mX = 123456789, mY = 362436069, mZ = 521288629;
 
-inline u64 randomU64() { 
-    rngX ^= rngX << 16;
-    rngX ^= rngX >> 5;
-    rngX ^= rngX << 1;
+    inline u64 next() { 
+        mX ^= mX << 16;
+        mX ^= mX >> 5;
+        mX ^= mX << 1;
 
-    u64 t = rngX;
-    rngX = rngY;
-    rngY = rngZ;
-    rngZ = t ^ rngX ^ rngY;
+        u64 t = mX;
+        mX = mY;
+        mY = mZ;
+        mZ = t ^ mX ^ mY;
 
-    return rngZ;
-}
+        return mZ;
+    }
+
+    // [0, 1)
+    inline double nextDouble() { return (double)(next() >> 11) / (double)(1ULL << 53); }
+
+}; // struct Rng
 
 template <typename T>
-inline void shuffleVector(std::vector<T> &vec)
+inline void shuffleVector(std::vector<T> &vec, Rng &rng)
 {
     for (u64 i = 0; i < vec.size(); i++) 
     {
-        auto newIdx = randomU64() % vec.size();
+        auto newIdx = rng.next() % vec.size();
         std::swap(vec[i], vec[newIdx]);
     }
 }
@@ -1,6 +1,8 @@
 // clang-format off
 #include "../src/board.hpp"
 #include "../src/perft.hpp"
+#include "../src/datagen.hpp"
+#include "../src/dfpn.hpp"
 
 const std::string POSITION2_KIWIPETE = "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - ";
 const std::string POSITION3 = "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - ";
@@ -110,6 +112,23 @@ int main()
     assert(pinnedNonDiagonally == 134217728ULL);
     assert(pinnedDiagonally == 268439552ULL);
 
+    // givesCheck()
+    board = Board("3k4/8/8/8/8/8/8/R3K3 w Q - 0 1");
+    assert(board.givesCheck(board.uciToMove("a1a8")));
+    assert(board.givesCheck(board.uciToMove("e1c1")));
+    assert(!board.givesCheck(board.uciToMove("e1f2")));
+    board = Board("4k3/8/8/8/8/8/4N3/4R1K1 w - - 0 1");
+    assert(board.givesCheck(board.uciToMove("e2c3")));
+    assert(!board.givesCheck(board.uciToMove("g1h1")));
+
+    // SEE()
+    board = Board("4k3/8/8/3p4/4P3/8/8/4K3 w - - 0 1");
+    assert(board.SEE(board.uciToMove("e4d5"), 0));
+    assert(!board.SEE(board.uciToMove("e4d5"), 101));
+    board = Board("4k3/8/2p5/3p4/8/8/3Q4/4K3 w - - 0 1");
+    assert(!board.SEE(board.uciToMove("d2d5"), 0));
+    assert(board.SEE(board.uciToMove("d2d3"), 0));
+
     // makeMove()
     board = Board("rnbqkb1r/4pppp/1p1p1n2/2p4P/2BP2P1/4PN2/p1P2P2/RNBQK2R b KQkq - 5 9");
     board.makeMove("a2b1q"); // black promotes to queen | rnbqkb1r/4pppp/1p1p1n2/2p4P/2BP2P1/4PN2/2P2P2/RqBQK2R w KQkq - 0 10
@@ -125,9 +144,75 @@ int main()
     board.makeMove("a1a2");  // white moves rook up (test 50move counter) | rnbqkb1r/4pp1p/1p1p2P1/2p5/2BP2n1/4PN2/R1P2P2/1qBQ1RK1 b kq - 1 12
     assert(board.fen() == "rnbqkb1r/4pp1p/1p1p2P1/2p5/2BP2n1/4PN2/R1P2P2/1qBQ1RK1 b kq - 1 12");
 
+    // Repetitions: twofold for the searches, threefold ends a game
+    Board repetitionBoard = Board(START_FEN);
+    for (int i = 0; i < 2; i++) {
+        for (std::string move : { "g1f3", "g8f6", "f3g1", "f6g8" })
+            repetitionBoard.makeMove(move);
+
+        assert(repetitionBoard.isRepetition() && repetitionBoard.isThreefoldRepetition() == (i == 1));
+    }
+
     // Zobrist hash
     assert(Board("rnbqkb1r/4pp1p/1p1p2P1/2p5/2BP2n1/4PN2/R1P2P2/1qBQ1RK1 b kq - 1 12").zobristHash() == board.zobristHash());
 
+    // Null move
+    Board nullMoveBoard = Board("rnbqkbnr/pppp1ppp/8/4p3/4P3/8/PPPP1PPP/RNBQKBNR w KQkq e6 0 2");
+    nullMoveBoard.makeNullMove();
+    assert(nullMoveBoard.zobristHash() == Board("rnbqkbnr/pppp1ppp/8/4p3/4P3/8/PPPP1PPP/RNBQKBNR b KQkq - 0 2").zobristHash());
+
+    // NNUE accumulator updated incrementally (promotion, castling, en passant, captures)
+    assert(Board("rnbqkb1r/4pp1p/1p1p2P1/2p5/2BP2n1/4PN2/R1P2P2/1qBQ1RK1 b kq - 1 12").evaluate() == board.evaluate());
+    assert(Board(START_FEN).evaluate() == 0);
+
+    // Datagen packed board (pieces, castling rights, en passant, counters)
+    for (std::string fen : { std::string(START_FEN), POSITION4, board2.fen(), board3.fen() }) {
+        Board unpacked = Board(fen);
+        assert(datagen::PackedBoard(unpacked).fen() == unpacked.fen());
+    }
+
+    // Mate search: shortest mate distance and first move (back rank mate in 1, mate in 2 after a rook sacrifice)
+    dfpn::mateTableMb = 1;
+    dfpn::mateTable.resize(dfpn::mateTableMb);
+    TimeManager mateTimeManager;
+    Board mateIn1 = Board("6k1/5ppp/8/8/8/8/8/R5K1 w - - 0 1");
+    Board mateIn2 = Board("1r4k1/5ppp/8/8/8/8/4RPPP/4R1K1 w - - 0 1");
+    assert(dfpn::MateSearch(mateIn1, I64_MAX, false).matePlies(5) == 1);
+    assert(dfpn::MateSearch(mateIn2, I64_MAX, false).matePlies(5) == 3);
+    assert(std::get<0>(dfpn::search(mateIn1, mateTimeManager, 3, I64_MAX, false)) == mateIn1.uciToMove("a1a8"));
+    assert(std::get<0>(dfpn::search(mateIn2, mateTimeManager, 3, I64_MAX, false)) == mateIn2.uciToMove("e2e8"));
+    assert(dfpn::MateSearch(Board(START_FEN), I64_MAX, false).matePlies(3) == 0);
+
+    // Only one alpha-beta or mate search at a time (process wide state), a concurrent one is rejected
+    {
+        ProcessSearchGuard otherSearch;
+        assert(otherSearch.acquired() && !ProcessSearchGuard().acquired());
+        assert(std::get<0>(dfpn::search(mateIn1, mateTimeManager, 3, I64_MAX, false)) == MOVE_NONE);
+    }
+    assert(ProcessSearchGuard().acquired());
+
+    // MCTS tree garbage collection, in tree and DAG mode: a small Hash keeps the tree under it, and the search
+    // still finds the move found without collection (win the queen)
+    for (i32 dagMode : { 0, 1 })
+    {
+        SearchParams gcParams;
+        gcParams.DAG_MODE.value = dagMode;
+        gcParams.SMART_PRUNING.value = 0;
+
+        Board gcBoard = Board("4k3/8/8/3q4/8/8/8/3RK3 w - - 0 1");
+        TimeManager gcTimeManager;
+        SearchContext context(gcParams);
+        context.setOutput(nullptr);
+
+        Move bigTreeMove = std::get<0>(context.search(gcBoard, gcTimeManager, SearchLimits { .maxNodes = 40000 }));
+        assert(context.treeBytes() > 1024 * 1024);
+
+        Move smallTreeMove = std::get<0>(context.search(gcBoard, gcTimeManager, SearchLimits { .maxNodes = 40000, .hashMb = 1 }));
+        assert(context.treeBytes() <= 1024 * 1024);
+
+        assert(smallTreeMove == bigTreeMove && bigTreeMove == gcBoard.uciToMove("d1d5"));
+    }
+
     // Perft
 
     board = Board(START_FEN);
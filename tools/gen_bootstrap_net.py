@@ -0,0 +1,62 @@
+#!/usr/bin/env python3
+# Writes the bootstrap value network src/net.nnue (see "Networks" in README.md)
+# No trained net exists yet, so the weights are set by hand: material, pawn advancement
+# and knight/bishop centralization, each carried by one hidden neuron
+# Layout (nnue.hpp, little endian i16):
+#   featureWeights[768][HIDDEN], featureBiases[HIDDEN], outputWeights[2][HIDDEN], outputBias, zero padding to 64 bytes
+# Feature index = pieceType * 64 + square for the perspective's own pieces (pieceType 0-5 = P N B R Q K)
+
+import struct
+import sys
+
+HIDDEN = 64
+QA, QB, SCALE = 255, 64, 400
+
+PIECE_VALUES = [100, 300, 315, 500, 900]   # P N B R Q, centipawns
+MATERIAL_WEIGHTS = [24, 60, 60, 80, 120]   # activation of neuron pieceType per piece, below QA
+PAWN_RANK_WEIGHT = 4                       # neuron 5: activation per rank of pawn advancement
+PAWN_RANK_CP = 5                           # centipawns per rank
+CENTER_WEIGHTS = {1: 10, 2: 5}             # neuron 6: knight and bishop activation per centralization step
+CENTER_CP = 8                              # centipawns per (knight) centralization step
+
+def center(square):
+    file, rank = square % 8, square // 8
+    return 3 - max(abs(2 * file - 7), abs(2 * rank - 7)) // 2
+
+def output_weight(cp, activation):
+    return round(cp * QA * QB / (SCALE * activation))
+
+feature_weights = [[0] * HIDDEN for _ in range(768)]
+
+for piece_type in range(5):
+    for square in range(64):
+        feature_weights[piece_type * 64 + square][piece_type] = MATERIAL_WEIGHTS[piece_type]
+
+for square in range(64):
+    rank = square // 8
+
+    if 1 <= rank <= 6:
+        feature_weights[square][5] = rank * PAWN_RANK_WEIGHT
+
+    for piece_type, weight in CENTER_WEIGHTS.items():
+        feature_weights[piece_type * 64 + square][6] = center(square) * weight
+
+# Side to move's accumulator adds, the other side's subtracts
+output_weights = [[0] * HIDDEN for _ in range(2)]
+
+for piece_type in range(5):
+    output_weights[0][piece_type] = output_weight(PIECE_VALUES[piece_type], MATERIAL_WEIGHTS[piece_type])
+
+output_weights[0][5] = output_weight(PAWN_RANK_CP, PAWN_RANK_WEIGHT)
+output_weights[0][6] = output_weight(CENTER_CP, CENTER_WEIGHTS[1])
+output_weights[1] = [-weight for weight in output_weights[0]]
+
+data = b''.join(struct.pack('<%dh' % HIDDEN, *row) for row in feature_weights)
+data += struct.pack('<%dh' % HIDDEN, *([0] * HIDDEN))
+data += b''.join(struct.pack('<%dh' % HIDDEN, *row) for row in output_weights)
+data += struct.pack('<h', 0)
+data += b'\0' * ((-len(data)) % 64)
+
+path = sys.argv[1] if len(sys.argv) > 1 else 'src/net.nnue'
+open(path, 'wb').write(data)
+print(path, len(data), 'bytes')
@@ -0,0 +1,41 @@
+#!/usr/bin/env python3
+# Writes the bootstrap policy src/policy.nnue (see "Networks" in README.md)
+# No trained policy exists yet: the hidden layer weights are zero and only the (piece, to square) biases
+# are set by hand, favoring central minor piece moves, pawn advances and castling,
+# and discouraging early queen and king moves
+# Layout (policy.hpp, little endian i16):
+#   fromWeights[64][HIDDEN], toWeights[6][64][HIDDEN], toBiases[6][64], zero padding to 64 bytes
+# Squares are from the side to move's perspective (flipped for black), pieceType 0-5 = P N B R Q K
+
+import struct
+import sys
+
+HIDDEN = 64
+QB = 64 # a bias of QB is a logit of 1
+
+def center(square):
+    file, rank = square % 8, square // 8
+    return 3 - max(abs(2 * file - 7), abs(2 * rank - 7)) // 2
+
+biases = [[0] * 64 for _ in range(6)]
+
+for square in range(64):
+    biases[0][square] = round(0.1 * QB * (square // 8))     # pawn: rank
+    biases[1][square] = round(0.25 * QB * center(square))   # knight
+    biases[2][square] = round(0.15 * QB * center(square))   # bishop
+    biases[4][square] = round(-0.25 * QB)                   # queen
+    biases[5][square] = round(-1.0 * QB)                    # king
+
+biases[5][6] = biases[5][2] = round(0.5 * QB) # castling (king to g1 or c1)
+
+data = struct.pack('<%dh' % (64 * HIDDEN), *([0] * (64 * HIDDEN)))
+data += struct.pack('<%dh' % (6 * 64 * HIDDEN), *([0] * (6 * 64 * HIDDEN)))
+
+for piece_type in range(6):
+    data += struct.pack('<64h', *biases[piece_type])
+
+data += b'\0' * ((-len(data)) % 64)
+
+path = sys.argv[1] if len(sys.argv) > 1 else 'src/policy.nnue'
+open(path, 'wb').write(data)
+print(path, len(data), 'bytes')